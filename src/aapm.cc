@@ -468,8 +468,30 @@ void YApm::AcpiStr(char *s, bool Tool) {
 
 }
 
+// Read an attribute of a power supply from sysfs, through a descriptor
+// which stays open.  The first of the two names which exists is kept.
+static const char* readSupply(YProcFile& file, const char* supply,
+                              const char* name, const char* alt = 0)
+{
+    if (file.path() && file.read() >= 0)
+        return file.text();
+
+    const char* names[] = { name, alt };
+    for (int i = 0; i < 2 && names[i]; ++i) {
+        char path[255];
+        snprintf(path, sizeof path, "/sys/class/power_supply/%s/%s",
+                 supply, names[i]);
+        file.setPath(path);
+        if (file.read() >= 0)
+            return file.text();
+    }
+    file.setPath(0);
+    return 0;
+}
+
 void YApm::SysStr(char *s, bool Tool) {
     char buf[255], bat_info[250];
+    const char* text;
 
     *s='\0';
 
@@ -477,21 +499,17 @@ void YApm::SysStr(char *s, bool Tool) {
     //the file in /sys/class/power_supply will contain unexpected values
     int ACstatus = -1;
     if (acpiACName && acpiACName[0] != 0) {
-        strcat3(buf, "/sys/class/power_supply/", acpiACName, "/online", sizeof(buf));
-        FILE* fd = fopen(buf, "r");
-        if (fd != NULL) {
-            while (fgets(buf, sizeof(buf), fd)) {
-                    if (strncmp(buf, "1", 1) == 0) {
-                        ACstatus = AC_ONLINE;
-                    }
-                    else if (strncmp(buf, "0", 1) == 0) {
-                        ACstatus = AC_OFFLINE;
-                    }
-                    else {
-                        ACstatus = AC_UNKNOWN;
-                    }
+        text = readSupply(fACOnline, acpiACName, "online");
+        if (text != NULL) {
+            if (strncmp(text, "1", 1) == 0) {
+                ACstatus = AC_ONLINE;
+            }
+            else if (strncmp(text, "0", 1) == 0) {
+                ACstatus = AC_OFFLINE;
+            }
+            else {
+                ACstatus = AC_UNKNOWN;
             }
-            fclose(fd);
         }
     }
 
@@ -500,7 +518,8 @@ void YApm::SysStr(char *s, bool Tool) {
 
     int n = 0;
     for (int i = 0; i < batteryNum; i++) {
-        const char* BATname = acpiBatteries[i]->name;
+        Battery* bat = acpiBatteries[i];
+        const char* BATname = bat->name;
         //assign some default values, in case
         //the files in /sys/class/power_supply will contain unexpected values
         bool BATpresent = BAT_ABSENT;
@@ -511,83 +530,54 @@ void YApm::SysStr(char *s, bool Tool) {
         int BATrate = -1;
         int BATtime_remain = -1;
 
-        strcat3(buf, "/sys/class/power_supply/", BATname, "/status", sizeof(buf));
-        FILE* fd = fopen(buf, "r");
-        if (fd == NULL) {
-                strcat3(buf, "/sys/class/power_supply/", BATname, "/power_now", sizeof(buf));
-                fd = fopen(buf, "r");
-        }
-
-        if (fd != NULL) {
-            if (fgets(buf, sizeof(buf), fd)) {
-                if (strncasecmp(buf, "charging", 8) == 0) {
-                        BATstatus = BAT_CHARGING;
-                    }
-                    else if (strncasecmp(buf, "discharging", 11) == 0) {
-                        BATstatus = BAT_DISCHARGING;
-                    }
-                    else if (strncasecmp(buf, "full", 4) == 0) {
-                        BATstatus = BAT_FULL;
-                    }
-                    else {
-                        BATstatus = BAT_UNKNOWN;
-                    }
+        text = readSupply(bat->status, BATname, "status", "power_now");
+        if (text != NULL) {
+            if (strncasecmp(text, "charging", 8) == 0) {
+                BATstatus = BAT_CHARGING;
+            }
+            else if (strncasecmp(text, "discharging", 11) == 0) {
+                BATstatus = BAT_DISCHARGING;
+            }
+            else if (strncasecmp(text, "full", 4) == 0) {
+                BATstatus = BAT_FULL;
+            }
+            else {
+                BATstatus = BAT_UNKNOWN;
             }
-            fclose(fd);
         }
 
         // XXX: investigate, if current_now is missing, can we stop polling it? For all or just for this battery?
-        strcat3(buf, "/sys/class/power_supply/", BATname, "/current_now", sizeof(buf));
-        fd = fopen(buf, "r");
-        if (fd == NULL) {
-            strcat3(buf, "/sys/class/power_supply/", BATname, "/power_now", sizeof(buf));
-            fd = fopen(buf, "r");
-        }
-        if (fd != NULL) {
-            if (fgets(buf, sizeof(buf), fd)) {
-                //In case it contains non-numeric value
-                if (sscanf(buf,"%d", &BATrate) <= 0) {
-                    BATrate = -1;
-                }
+        text = readSupply(bat->rate, BATname, "current_now", "power_now");
+        if (text != NULL) {
+            //In case it contains non-numeric value
+            if (sscanf(text, "%d", &BATrate) <= 0) {
+                BATrate = -1;
             }
-            fclose(fd);
         }
 
-        strcat3(buf, "/sys/class/power_supply/", BATname, "/energy_now", sizeof(buf));
-        fd = fopen(buf, "r");
-        if (fd == NULL) {
-            strcat3(buf, "/sys/class/power_supply/", BATname, "/charge_now", sizeof(buf));
-            fd = fopen(buf, "r");
-        }
-        if (fd != NULL) {
-            if (fgets(buf, sizeof(buf), fd)) {
-                //In case it contains non-numeric value
-                if (sscanf(buf,"%d", &BATcapacity_remain) <= 0) {
-                    BATcapacity_remain = -1;
-                }
+        text = readSupply(bat->energy, BATname, "energy_now", "charge_now");
+        if (text != NULL) {
+            //In case it contains non-numeric value
+            if (sscanf(text, "%d", &BATcapacity_remain) <= 0) {
+                BATcapacity_remain = -1;
             }
-            fclose(fd);
         }
 
-        strcat3(buf, "/sys/class/power_supply/", BATname, "/present", sizeof(buf));
-        fd = fopen(buf, "r");
-        if (fd != NULL) {
-            if (fgets(buf, sizeof(buf), fd)) {
-                if (strncmp(buf, "1", 1) == 0) {
-                    BATpresent = BAT_PRESENT;
-                }
-                else {
-                    BATpresent = BAT_ABSENT;
-                }
+        text = readSupply(bat->presence, BATname, "present");
+        if (text != NULL) {
+            if (strncmp(text, "1", 1) == 0) {
+                BATpresent = BAT_PRESENT;
+            }
+            else {
+                BATpresent = BAT_ABSENT;
             }
-            fclose(fd);
         }
 
         if (BATpresent == BAT_PRESENT) { //battery is present now
             if (acpiBatteries[i]->present == BAT_ABSENT) { //and previously was absent
                 //read full-capacity value
                 strcat3(buf, "/sys/class/power_supply/", BATname, "/energy_full_design", sizeof(buf));
-                fd = fopen(buf, "r");
+                FILE* fd = fopen(buf, "r");
                 if (fd == NULL) {
                     strcat3(buf, "/sys/class/power_supply/", BATname, "/charge_full_design", sizeof(buf));
                     fd = fopen(buf, "r");
@@ -3,6 +3,7 @@
 
 #include "ywindow.h"
 #include "ytimer.h"
+#include "yprocfile.h"
 
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || defined(__NetBSD__) || defined(__OpenBSD__)
 #define APMDEV "/dev/apm"
@@ -19,6 +20,8 @@ struct Battery {
   char *name;
   bool present;
   int capacity_full;
+  //sysfs attributes which are read on every update
+  YProcFile status, rate, energy, presence;
   Battery(const char* batName) : name(newstr(batName)),
           present(false), capacity_full(-1) { }
   ~Battery() { delete[] name; name = 0; }
@@ -68,6 +71,7 @@ private:
     Battery *acpiBatteries[MAX_ACPI_BATTERY_NUM];
     //(file)name of ac adapter
     char *acpiACName;
+    YProcFile fACOnline;
     char *fCurrentState;
 
     // On line status and charge persent
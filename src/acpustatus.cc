@@ -76,7 +76,8 @@ extern ref<YPixmap> taskbackPixmap;
 
 ref<YFont> CPUStatus::tempFont;
 
-CPUStatus::CPUStatus(YWindow *aParent, CPUStatusHandler *aHandler, int cpuid) :
+CPUStatus::CPUStatus(YWindow *aParent, CPUStatusHandler *aHandler, int cpuid,
+                     const cpubytes* sample) :
     IApplet(this, aParent),
     fCpuID(cpuid),
     statusUpdateCount(0),
@@ -90,8 +91,6 @@ CPUStatus::CPUStatus(YWindow *aParent, CPUStatusHandler *aHandler, int cpuid) :
     }
     memset(last_cpu, 0, sizeof(last_cpu));
 
-    fUpdateTimer->setTimer(taskBarCPUDelay, this, true);
-
     tempColor = &clrCpuTemp;
 
     color[IWM_USER] = &clrCpuUser;
@@ -108,8 +107,8 @@ CPUStatus::CPUStatus(YWindow *aParent, CPUStatusHandler *aHandler, int cpuid) :
     ShowAcpiTemp = cpustatusShowAcpiTemp;
     ShowCpuFreq = cpustatusShowCpuFreq;
     ShowAcpiTempInGraph = cpustatusShowAcpiTempInGraph;
-    getStatus();
-    updateStatus();
+    getStatus(sample);
+    updateStatus(sample);
     updateToolTip();
     char buf[99];
     snprintf(buf, 99, "CPU%d", cpuid);
@@ -275,13 +274,10 @@ void CPUStatus::temperature(Graphics& g) {
     }
 }
 
-bool CPUStatus::handleTimer(YTimer *t) {
-    if (t != fUpdateTimer)
-        return false;
+void CPUStatus::timedUpdate(const cpubytes* sample) {
     if (toolTipVisible())
         updateToolTip();
-    updateStatus();
-    return true;
+    updateStatus(sample);
 }
 
 void CPUStatus::updateToolTip() {
@@ -394,10 +390,9 @@ void CPUStatus::handleClick(const XButtonEvent &up, int count) {
     }
 }
 
-void CPUStatus::updateStatus() {
-    for (int i(1); i < taskBarCPUSamples; i++)
-        cpu.copyTo(i, i - 1);
-    getStatus();
+void CPUStatus::updateStatus(const cpubytes* sample) {
+    cpu.rotate();
+    getStatus(sample);
     repaint();
 }
 
@@ -495,58 +490,14 @@ float CPUStatus::getCpuFreq(unsigned int cpu) {
 }
 
 
-void CPUStatus::getStatusPlatform() {
+void CPUStatus::getStatusPlatform(const cpubytes* sample) {
 #ifdef __linux__
-    char *p = 0, buf[4096], *end = 0;
-    unsigned long long cur[IWM_STATES];
-    int s;
-
-    fileptr fd(fopen("/proc/stat", "r"));
-    if (fd == NULL)
-        return;
-
-    while (fgets(buf, sizeof buf, fd) && 0 == strncmp(buf, "cpu", 3)) {
-        if (fCpuID == -1) {
-            if (ASCII::isSpaceOrTab(buf[3]))
-                p = buf + 4;
-            break;
-        }
-        if (ASCII::isDigit(buf[3]) && strtol(buf + 3, &end, 10) == fCpuID) {
-            if (end > buf && ASCII::isSpaceOrTab(*end)) {
-                p = 1 + end;
-                break;
-            }
-        }
-    }
-    fd.close();
-    if (p == 0)
+    if (sample == 0)
         return;
 
-    s = sscanf(p, "%llu %llu %llu %llu %llu %llu %llu %llu",
-               &cur[IWM_USER],    &cur[IWM_NICE],
-               &cur[IWM_SYS],     &cur[IWM_IDLE],
-               &cur[IWM_IOWAIT],  &cur[IWM_INTR],
-               &cur[IWM_SOFTIRQ], &cur[IWM_STEAL]);
-    switch (s) {
-    case 4:
-        /* Linux 2.4 */
-        cur[IWM_INTR]    =
-        cur[IWM_IOWAIT]  =
-        cur[IWM_SOFTIRQ] = 0;
-        /* FALL THROUGH */
-    case 7:
-        /* Linux < 2.6.11 */
-        cur[IWM_STEAL] = 0;
-        /* FALL THROUGH */
-    case 8:
-        break;
-    default:
-        return;
-    }
-    int i = 0;
-    for (i = 0; i < IWM_STATES; i++) {
-        cpu[taskBarCPUSamples - 1][i] = cur[i] - last_cpu[i];
-        last_cpu[i] = cur[i];
+    for (int i = 0; i < IWM_STATES; i++) {
+        cpu[taskBarCPUSamples - 1][i] = sample[i] - last_cpu[i];
+        last_cpu[i] = sample[i];
     }
 
     return;
@@ -762,10 +713,10 @@ void CPUStatus::getStatusPlatform() {
 #endif
 }
 
-void CPUStatus::getStatus() {
+void CPUStatus::getStatus(const cpubytes* sample) {
     cpu.clear(taskBarCPUSamples - 1);
 
-    getStatusPlatform();
+    getStatusPlatform(sample);
 
     MSG((_("CPU: %llu %llu %llu %llu %llu %llu %llu %llu"),
         cpu[taskBarCPUSamples - 1][IWM_USER],
@@ -792,27 +743,124 @@ CPUStatusControl::CPUStatusControl(YSMListener *smActionListener,
     aParent(aParent),
     fMenuCPU(-1),
     fPid(0)
+#ifdef __linux__
+    , fStat("/proc/stat")
+    , fStatCount(0)
+#endif
 {
+#ifdef __linux__
+    fetchSystemData();
+#endif
     GetCPUStatus(cpuCombine);
+    fUpdateTimer->setTimer(taskBarCPUDelay, this, true);
+}
+
+bool CPUStatusControl::handleTimer(YTimer *t) {
+    if (t != fUpdateTimer)
+        return false;
+
+#ifdef __linux__
+    fetchSystemData();
+#endif
+    for (IterType iter = getIterator(); ++iter; )
+        iter->timedUpdate(sample(iter->getCpuID()));
+
+    return true;
+}
+
+#ifdef __linux__
+const cpubytes* CPUStatusControl::sample(int cpuid) const {
+    int row = cpuid + 1;
+    if (row < 0 || row >= fStatValid.getCount() || fStatValid[row] == false)
+        return 0;
+    return &fStatRows[row * IWM_STATES];
+}
+
+// Read /proc/stat through one descriptor and parse the rows of all
+// CPUs in a single pass.  Reading stops before the interrupt counts,
+// unless the buffer was too small for the CPU rows.
+bool CPUStatusControl::fetchSystemData() {
+    if (fStat.read("cpu") <= 0)
+        return false;
+
+    for (int i = 0; i < fStatValid.getCount(); ++i)
+        fStatValid[i] = false;
+    fStatCount = 0;
+
+    for (char* line = fStat.text(); 0 == strncmp(line, "cpu", 3); ) {
+        char* next = strchr(line, '\n');
+        if (next == 0)
+            break;
+        *next = '\0';
+        parseRow(line);
+        line = next + 1;
+    }
+    return true;
 }
 
+void CPUStatusControl::parseRow(char* line) {
+    int row;
+    char* p = line + 3;
+    if (ASCII::isSpaceOrTab(*p)) {
+        row = 0;
+    }
+    else if (ASCII::isDigit(*p)) {
+        char* end = 0;
+        long id = strtol(p, &end, 10);
+        if (end == p || !ASCII::isSpaceOrTab(*end) || id < 0 || id > 99999)
+            return;
+        row = int(id) + 1;
+        p = end;
+        ++fStatCount;
+    }
+    else
+        return;
+
+    // user nice system idle iowait irq softirq steal
+    static const int order[IWM_STATES] = {
+        IWM_USER, IWM_NICE, IWM_SYS, IWM_IDLE,
+        IWM_IOWAIT, IWM_INTR, IWM_SOFTIRQ, IWM_STEAL,
+    };
+    cpubytes cur[IWM_STATES] = { 0, };
+    int s = 0;
+    for (; s < IWM_STATES; ++s) {
+        char* end = 0;
+        cpubytes value = strtoull(p, &end, 10);
+        if (end == p)
+            break;
+        cur[order[s]] = value;
+        p = end;
+    }
+    /* Linux 2.4 has 4 counters, Linux < 2.6.11 has 7 */
+    if (s != 4 && s != 7 && s != 8)
+        return;
+
+    while (fStatValid.getCount() <= row) {
+        fStatValid.append(false);
+        for (int i = 0; i < IWM_STATES; ++i)
+            fStatRows.append(0);
+    }
+    for (int i = 0; i < IWM_STATES; ++i)
+        fStatRows[row * IWM_STATES + i] = cur[i];
+    fStatValid[row] = true;
+}
+#else
+const cpubytes* CPUStatusControl::sample(int cpuid) const {
+    return 0;
+}
+#endif
+
 void CPUStatusControl::GetCPUStatus(bool combine) {
     if (combine) {
         getCPUStatusCombined();
         return;
     }
 #if defined(__linux__)
-    char buf[128];
-    unsigned cnt = 0;
-    FILE *fd = fopen("/proc/stat", "r");
-    if (!fd) {
+    if (fStat.isOpen() == false) {
         getCPUStatusCombined();
         return;
     }
-    while (fgets(buf, sizeof buf, fd) && 0 == strncmp(buf, "cpu", 3))
-        cnt += ASCII::isDigit(buf[3]);
-    fclose(fd);
-    getCPUStatus(cnt);
+    getCPUStatus(unsigned(fStatCount));
 #elif defined(HAVE_KSTAT_H)
     kstat_named_t       *kn = NULL;
     kn = (kstat_named_t *)kstat_data_lookup(ks, "ncpus");
@@ -841,7 +889,7 @@ void CPUStatusControl::getCPUStatus(unsigned ncpus)
 
 CPUStatus* CPUStatusControl::createStatus(unsigned cpu)
 {
-    return new CPUStatus(aParent, this, cpu);
+    return new CPUStatus(aParent, this, cpu, sample(int(cpu)));
 }
 
 void CPUStatusControl::runCommandOnce(const char *resource, const char *cmdline)
@@ -13,6 +13,8 @@
 #define IWM_STEAL  (7)
 #define IWM_STATES (8)
 
+#include "yprocfile.h"
+
 class YSMListener;
 
 typedef unsigned long long cpubytes;
@@ -24,18 +26,20 @@ public:
     virtual void runCommandOnce(const char *resource, const char *cmdline) = 0;
 };
 
-class CPUStatus: public IApplet, private Picturer, private YTimerListener {
+class CPUStatus: public IApplet, private Picturer {
 public:
-    CPUStatus(YWindow *aParent, CPUStatusHandler *aHandler, int cpuid = -1);
+    CPUStatus(YWindow *aParent, CPUStatusHandler *aHandler, int cpuid = -1,
+              const cpubytes* sample = 0);
     virtual ~CPUStatus();
 
     virtual void paint(Graphics &g, const YRect &r);
-    virtual bool handleTimer(YTimer *t);
     virtual void handleClick(const XButtonEvent &up, int count);
 
-    void updateStatus();
-    void getStatus();
-    void getStatusPlatform();
+    // The sample has the IWM_STATES counters of this CPU, if known.
+    void timedUpdate(const cpubytes* sample);
+    void updateStatus(const cpubytes* sample);
+    void getStatus(const cpubytes* sample);
+    void getStatusPlatform(const cpubytes* sample);
     int getAcpiTemp(char* tempbuf, int buflen);
     float getCpuFreq(unsigned int cpu);
     int getCpuID() const { return fCpuID; }
@@ -48,7 +52,6 @@ private:
     YMulti<cpubytes> cpu;
     cpubytes last_cpu[IWM_STATES];
     YColorName color[IWM_STATES];
-    lazy<YTimer> fUpdateTimer;
     CPUStatusHandler *fHandler;
     bool ShowRamUsage, ShowSwapUsage, ShowAcpiTemp, ShowCpuFreq,
          ShowAcpiTempInGraph;
@@ -63,7 +66,10 @@ private:
     static ref<YFont> tempFont;
 };
 
-class CPUStatusControl : private CPUStatusHandler, public YActionListener
+class CPUStatusControl :
+    private CPUStatusHandler,
+    private YTimerListener,
+    public YActionListener
 {
 public:
     typedef YObjectArray<CPUStatus> ArrayType;
@@ -74,6 +80,8 @@ public:
 
     IterType getIterator() { return fCPUStatus.iterator(); }
 
+    virtual bool handleTimer(YTimer *t);
+
 private:
     void GetCPUStatus(bool combine);
     void getCPUStatusCombined();
@@ -91,6 +99,19 @@ private:
     osmart<YMenu> fMenu;
     int fMenuCPU;
     long fPid;
+    lazy<YTimer> fUpdateTimer;
+
+    // The counters of all CPUs, read from procfs once for all monitors.
+    const cpubytes* sample(int cpuid) const;
+#ifdef __linux__
+    YProcFile fStat;
+    int fStatCount;
+    YArray<cpubytes> fStatRows;     // IWM_STATES per row, the total first
+    YArray<bool> fStatValid;
+
+    bool fetchSystemData();
+    void parseRow(char* line);
+#endif
 };
 
 #endif
@@ -25,6 +25,7 @@ extern ref<YPixmap> taskbackPixmap;
 MEMStatus::MEMStatus(IAppletContainer* taskBar, YWindow *aParent):
     IApplet(this, aParent),
     samples(taskBarMEMSamples, MEM_STATES),
+    fMeminfo("/proc/meminfo"),
     statusUpdateCount(0),
     unchanged(taskBarMEMSamples),
     taskBar(taskBar)
@@ -185,9 +186,7 @@ void MEMStatus::updateToolTip() {
 }
 
 void MEMStatus::updateStatus() {
-    for (int i(1); i < taskBarMEMSamples; i++) {
-        samples.copyTo(i, i - 1);
-    }
+    samples.rotate();
     getStatus();
     repaint();
 }
@@ -225,9 +224,9 @@ void MEMStatus::getStatus() {
     cur[MEM_FREE] = 1;
 
 #ifdef USE_PROC_MEMINFO
-    char buf[4096];
-    int len = read_file("/proc/meminfo", buf, sizeof buf);
+    int len = fMeminfo.read();
     if (len > 0) {
+        const char* buf = fMeminfo.text();
         cur[MEM_BUFFERS] = parseField(buf, len, "Buffers:");
         cur[MEM_CACHED] = parseField(buf, len, "Cached:");
         cur[MEM_FREE] = parseField(buf, len, "MemFree:");
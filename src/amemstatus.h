@@ -4,6 +4,7 @@
 #if defined(__linux__)
 
 #include "ypointer.h"
+#include "yprocfile.h"
 
 // graphed from the bottom up:
 #define MEM_USER    (0)
@@ -43,6 +44,7 @@ private:
     YMulti<membytes> samples;
     YColorName color[MEM_STATES];
     lazy<YTimer> fUpdateTimer;
+    YProcFile fMeminfo;
 
     bool picture();
     void fill(Graphics& g);
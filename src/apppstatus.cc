@@ -59,8 +59,7 @@ NetStatus::NetStatus(
     YWindow *aParent):
     IApplet(this, aParent),
     fHandler(handler),
-    ppp_in(new long[taskBarNetSamples]),
-    ppp_out(new long[taskBarNetSamples]),
+    ppp(taskBarNetSamples, PPP_DIRS),
     prev_ibytes(0),
     start_ibytes(0),
     cur_ibytes(0),
@@ -79,8 +78,7 @@ NetStatus::NetStatus(
     fDevName(netdev),
     fDevice(getNetDevice(netdev))
 {
-    for (int i = 0; i < taskBarNetSamples; i++)
-        ppp_in[i] = ppp_out[i] = 0;
+    clearRates();
 
     color[0] = &clrNetReceive;
     color[1] = &clrNetSend;
@@ -98,8 +96,14 @@ NetStatus::NetStatus(
 }
 
 NetStatus::~NetStatus() {
-    delete[] ppp_in;
-    delete[] ppp_out;
+}
+
+void NetStatus::clearRates() {
+    ppp.clear();
+    for (int k = 0; k < PPP_DIRS; ++k) {
+        pppSum[k] = 0;
+        pppMax[k] = 0;
+    }
 }
 
 void NetStatus::updateVisible(bool aVisible) {
@@ -120,8 +124,7 @@ void NetStatus::timedUpdate(const void* sharedData, bool forceDown) {
 
     if (up) {
         if (!wasUp) {
-            for (int i = 0; i < taskBarNetSamples; i++)
-                ppp_in[i] = ppp_out[i] = 0;
+            clearRates();
 
             start_time = monotime();
             cur_ibytes = 0;
@@ -160,8 +163,8 @@ void NetStatus::updateToolTip() {
         long long vi(cur_ibytes);
         long long vo(cur_obytes);
 
-        long ci(ppp_in[taskBarNetSamples - 1]);
-        long co(ppp_out[taskBarNetSamples - 1]);
+        long ci(ppp[taskBarNetSamples - 1][PPP_IN]);
+        long co(ppp[taskBarNetSamples - 1][PPP_OUT]);
 
         /* ai and oi were keeping nonsenses (if were not reset by
          * double-click) because of bad control of start_obytes and
@@ -172,15 +175,8 @@ void NetStatus::updateToolTip() {
          * related to uptime of machine as was displayed before) -stibor- */
 /*      long ai(t ? vi / t : 0);
         long ao(t ? vo / t : 0); */
-        long long cai = 0;
-        long long cao = 0;
-
-        for (int ii = 0; ii < taskBarNetSamples; ii++) {
-            cai += ppp_in[ii];
-            cao += ppp_out[ii];
-        }
-        cai /= taskBarNetSamples;
-        cao /= taskBarNetSamples;
+        long long cai = pppSum[PPP_IN] / taskBarNetSamples;
+        long long cao = pppSum[PPP_OUT] / taskBarNetSamples;
 
         const char * const viUnit(niceUnit(vi, sizeUnits));
         const char * const voUnit(niceUnit(vo, sizeUnits));
@@ -267,22 +263,19 @@ void NetStatus::fill(Graphics& g) {
     }
 }
 
+// Round the scale of the graph up to four steps per doubling,
+// because every change of the scale redraws all samples.
+static long graphScale(long bytes) {
+    long step = 1;
+    while ((bytes - 1) / 8 >= step)
+        step *= 2;
+    return (bytes - 1) / step * step + step;
+}
+
 void NetStatus::draw(Graphics &g) {
     long h = height();
 
-    long b_in_max = 0;
-    long b_out_max = 0;
-
-    for (int i = 0; i < taskBarNetSamples; i++) {
-        long in = ppp_in[i];
-        long out = ppp_out[i];
-        if (in > b_in_max)
-            b_in_max = in;
-        if (out > b_out_max)
-            b_out_max = out;
-    }
-
-    long maxBytes = max(b_in_max + b_out_max, 1024L);
+    long maxBytes = graphScale(max(pppMax[PPP_IN] + pppMax[PPP_OUT], 1024L));
     int first = (maxBytes != oldMaxBytes) ? 0 :
                 max(0, taskBarNetSamples - statusUpdateCount);
     if (0 < first && first < taskBarNetSamples)
@@ -293,16 +286,17 @@ void NetStatus::draw(Graphics &g) {
     oldMaxBytes = maxBytes;
 
     for (int i = first; i < limit; i++) {
-        if (1 /* ppp_in[i] > 0 || ppp_out[i] > 0 */) {
+        const long* rate = ppp[i];
+        if (1 /* rate[PPP_IN] > 0 || rate[PPP_OUT] > 0 */) {
             long round = maxBytes / h / 2;
             int inbar, outbar;
 
-            if ((inbar = (h * (long long) (ppp_in[i] + round)) / maxBytes)) {
+            if ((inbar = (h * (long long) (rate[PPP_IN] + round)) / maxBytes)) {
                 g.setColor(color[0]);   /* h - 1 means bottom */
                 g.drawLine(i, h - 1, i, h - inbar);
             }
 
-            if ((outbar = (h * (long long) (ppp_out[i] + round)) / maxBytes)) {
+            if ((outbar = (h * (long long) (rate[PPP_OUT] + round)) / maxBytes)) {
                 g.setColor(color[1]);   /* 0 means top */
                 g.drawLine(i, 0, i, outbar - 1);
             }
@@ -457,22 +451,34 @@ bool NetLinuxDevice::isUp() {
 void NetStatus::updateStatus(const void* sharedData) {
     int last = taskBarNetSamples - 1;
 
-    for (int i = 0; i < last; i++) {
-        ppp_in[i] = ppp_in[i + 1];
-        ppp_out[i] = ppp_out[i + 1];
+    // The maxima are searched again only when the oldest sample had one.
+    bool rescan = false;
+    for (int k = 0; k < PPP_DIRS; ++k) {
+        pppSum[k] -= ppp[0][k];
+        rescan |= (0 < ppp[0][k] && pppMax[k] <= ppp[0][k]);
     }
-    getCurrent(&ppp_in[last], &ppp_out[last], sharedData);
+    ppp.rotate();
+
+    long* cur = ppp[last];
+    getCurrent(&cur[PPP_IN], &cur[PPP_OUT], sharedData);
     /* These two lines clears first measurement; you can throw these lines
      * off, but bug will occur: on startup, the _second_ bar will show
      * always zero -stibor- */
     if (!wasUp)
-        ppp_in[last] = ppp_out[last] = 0;
+        cur[PPP_IN] = cur[PPP_OUT] = 0;
+
+    for (int k = 0; k < PPP_DIRS; ++k) {
+        pppSum[k] += cur[k];
+        pppMax[k] = rescan ? 0 : max(pppMax[k], cur[k]);
+    }
+    for (int i = 0; rescan && i <= last; i++) {
+        for (int k = 0; k < PPP_DIRS; ++k)
+            pppMax[k] = max(pppMax[k], ppp[i][k]);
+    }
 
     ++statusUpdateCount;
 
-    bool same = (0 < last &&
-                 ppp_in[last] == ppp_in[last - 1] &&
-                 ppp_out[last] == ppp_out[last - 1]);
+    bool same = 0 < last && 0 == ppp.compare(last, last - 1);
     unchanged = same ? 1 + unchanged : 0;
 
     repaint();
@@ -597,12 +603,11 @@ NetStatusControl::~NetStatusControl() {
 
 #ifdef __linux__
 void NetStatusControl::fetchSystemData() {
-    devStats.clear();
-    devicesText = load_text_file("/proc/net/dev");
-    if (devicesText == 0)
+    devStats.shrink(0);
+    if (fDevices.read() <= 0)
         return;
 
-    for (char* p = devicesText; (p = strchr(p, '\n')) != 0; ) {
+    for (char* p = fDevices.text(); (p = strchr(p, '\n')) != 0; ) {
         *p = 0;
         while (*++p == ' ');
         char* name = p;
@@ -623,6 +628,9 @@ NetStatusControl::NetStatusControl(IApp* app, YSMListener* smActionListener,
     taskBar(taskBar),
     aParent(aParent),
     fPid(0)
+#ifdef __linux__
+    , fDevices("/proc/net/dev")
+#endif
 {
     mstring devName, devList(netDevice);
     while (devList.splitall(' ', &devName, &devList)) {
@@ -802,8 +810,7 @@ void NetStatusControl::linuxUpdate() {
         }
     }
 
-    devStats.clear();
-    devicesText = 0;
+    devStats.shrink(0);
 }
 #endif
 
@@ -18,6 +18,7 @@
 #if HAVE_NET_STATUS
 
 #include "ypointer.h"
+#include "yprocfile.h"
 
 class IAppletContainer;
 class NetStatusControl;
@@ -89,8 +90,10 @@ private:
     NetStatusHandler* fHandler;
     YColorName color[3];
 
-    long *ppp_in; /* long could be really enough for rate in B/s */
-    long *ppp_out;
+    enum { PPP_IN, PPP_OUT, PPP_DIRS };
+    YMulti<long> ppp; /* long could be really enough for rate in B/s */
+    long long pppSum[PPP_DIRS];     // totals of the rates in ppp
+    long pppMax[PPP_DIRS];          // maxima of the rates in ppp
 
     netbytes prev_ibytes, start_ibytes, cur_ibytes, offset_ibytes;
     netbytes prev_obytes, start_obytes, cur_obytes, offset_obytes;
@@ -111,6 +114,7 @@ private:
     // methods local to this class
     void getCurrent(long *in, long *out, const void* sharedData);
     void updateStatus(const void* sharedData);
+    void clearRates();
     virtual void updateToolTip() OVERRIDE;
 
     // methods overridden from superclasses
@@ -148,7 +152,7 @@ private:
 
 #ifdef __linux__
     // preprocessed data from procfs with offset table (name, values, name, vaues, ...)
-    csmart devicesText;
+    YProcFile fDevices;
     YArray<netpair> devStats;
     typedef YArray<netpair>::IterType IterStats;
 
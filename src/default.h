@@ -144,6 +144,7 @@ XIV(bool, protectClientWindow,                  true)
 XIV(int, MenuMaximalWidth,                      0)
 XIV(int, EdgeResistance,                        32)
 XIV(int, snapDistance,                          8)
+XIV(int, moveSizeRate,                          0)
 XIV(int, pointerFocusDelay,                     200)
 XIV(int, autoRaiseDelay,                        400)
 XIV(int, autoHideDelay,                         300)
@@ -387,6 +388,7 @@ cfoption icewm_preferences[] = {
     OIV("EdgeResistance",                       &EdgeResistance, 0, 10000,      "Resistance in pixels when trying to move windows off the screen (10000 = infinite)"),
     OIV("PointerFocusDelay",                    &pointerFocusDelay, 0, 1000,    "Delay for pointer focus switching"),
     OIV("SnapDistance",                         &snapDistance, 0, 64,           "Distance in pixels before windows snap together"),
+    OIV("MoveSizeRate",                         &moveSizeRate, 0, 1000,         "Updates per second while moving or sizing a window opaquely, 0 for the display refresh rate"),
     OIV("EdgeSwitchDelay",                      &edgeSwitchDelay, 0, 5000,      "Screen edge workspace switching delay"),
     OIV("ScrollBarStartDelay",                  &scrollBarStartDelay, 0, 5000,  "Inital scroll bar autoscroll delay"),
     OIV("ScrollBarDelay",                       &scrollBarDelay, 0, 5000,       "Scroll bar autoscroll delay"),
@@ -420,6 +422,7 @@ cfoption icewm_preferences[] = {
     OIV("NestedThemeMenuMinNumber",             &nestedThemeMenuMinNumber,  0, 1234,  "Minimal number of themes after which the Themes menu becomes nested (0=disabled)"),
     OIV("BatteryPollingPeriod",                 &batteryPollingPeriod, 2, 3600, "Delay between power status updates (seconds)"),
     OIV("NetWorkAreaBehaviour",                 &netWorkAreaBehaviour, 0, 2,    "NET_WORKAREA behaviour: 0 (single/multimonitor with STRUT information, like metacity), 1 (always full desktop), 2 (singlemonitor with STRUT, multimonitor without STRUT)"),
+    OIV("IconCacheSize",                        &iconCacheSize, 0, 1048576,     "Memory in kilobytes for decoded icons (0 means unlimited)"),
 ///    OSV("Theme",                                &themeName,                     "Theme name"),
     OSV("IconPath",                             &iconPath,                      "Icon search path (colon separated)"),
     OSV("MailBoxPath",                          &mailBoxPath,                   "Mailbox path (use $MAIL instead)"),
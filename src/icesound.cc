@@ -48,13 +48,18 @@
  */
 #include "config.h"
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <signal.h>
+#include <string.h>
 #include <X11/Xlib.h>
 
 #include "ytimer.h"
 #include "base.h"
 #include "ypointer.h"
 #include "upath.h"
+#include "yarray.h"
 #include "intl.h"
 #define GUI_EVENT_NAMES
 #include "guievent.h"
@@ -90,6 +95,12 @@ char const * ApplicationName = "icesound";
 #define ALSA_DEFAULT_DEVICE "default"
 #define OSS_DEFAULT_DEVICE "/dev/dsp"
 #define DEFAULT_SNOOZE_TIME 500L
+#define DEFAULT_SAMPLE_RATE 44100
+#define DEFAULT_CHANNELS 2
+#define ALSA_LATENCY 50000U     // microseconds of buffering
+#define MIXER_PERIOD 1024       // frames mixed at a time
+#define DEFAULT_VOICES 4
+#define DEFAULT_MAX_AGE 250L
 
 enum IcesoundStatus {
     ICESOUND_SUCCESS  = 0,
@@ -125,6 +136,14 @@ public:
     virtual const char* alsaDevice() const = 0;
     virtual const char* ossDevice() const = 0;
     virtual const char* esdServer() const = 0;
+    virtual bool latency() const = 0;
+
+    /**
+     * The number of samples which may play at the same time and
+     * the age in milliseconds after which an event is too late.
+     */
+    virtual int voiceLimit() const = 0;
+    virtual long maxAge() const = 0;
 
     /**
      * Finds a filename for sample with the specified gui event.
@@ -136,18 +155,101 @@ public:
 
 class YAudioInterface {
 public:
+    YAudioInterface() :
+        sampleRate(DEFAULT_SAMPLE_RATE),
+        channels(DEFAULT_CHANNELS)
+    {
+    }
     virtual ~YAudioInterface() {}
+
+    /**
+     * Open the device and configure it once for 16-bit samples
+     * at rate() and channelCount().
+     */
     virtual int init(SoundConf* conf) = 0;
 
     /**
-     * Play the sound for the given event.
-     * Return true iff the sound is playable.
+     * Queue interleaved frames in the format of the device.
+     * Return false iff the device failed.
      */
-    virtual bool play(int sound) = 0;
-    virtual void reload() {}
+    virtual bool write(const short* data, int frames) = 0;
     virtual void drain() {}
+
+    /**
+     * The buffering latency of the device in microseconds, if known.
+     */
+    virtual long latency() { return 0; }
+
+    int rate() const { return sampleRate; }
+    int channelCount() const { return channels; }
+
+protected:
+    int sampleRate;
+    int channels;
+};
+
+/******************************************************************************
+ * A sound sample decoded into memory in the format of the audio device
+ ******************************************************************************/
+
+class YSample {
+public:
+    YSample(short* data, int frames) : data(data), frames(frames) {}
+    ~YSample() { delete[] data; }
+
+    short* const data;      // interleaved frames
+    int const frames;
+
+    /**
+     * Decode a sound file and convert it to rate and channels.
+     * Returns NULL on error.
+     */
+    static YSample* load(const char* file, int rate, int channels);
 };
 
+YSample* YSample::load(const char* file, int rate, int channels) {
+    SF_INFO sfinfo = {};
+    SNDFILE* sf = sf_open(file, SFM_READ, &sfinfo);
+    if (sf == NULL) {
+        warn("%s: %s", file, sf_strerror(sf));
+        return NULL;
+    }
+    if (sfinfo.channels < 1 || sfinfo.samplerate < 1 ||
+        sfinfo.frames < 1 || sfinfo.frames > INT_MAX / sfinfo.channels)
+    {
+        warn(_("%s: Invalid number of channels"), file);
+        sf_close(sf);
+        return NULL;
+    }
+
+    const int source = sfinfo.channels;
+    asmart<short> in(new short[sfinfo.frames * source]);
+    const long count = long(sf_readf_short(sf, in, sfinfo.frames));
+    sf_close(sf);
+    if (count < 1)
+        return NULL;
+
+    // Resample by linear interpolation and map the channels.
+    const double step = double(sfinfo.samplerate) / rate;
+    const long frames = long(count / step);
+    if (frames < 1 || frames > INT_MAX / channels)
+        return NULL;
+    short* data = new short[frames * channels];
+    for (long i = 0; i < frames; ++i) {
+        const double pos = i * step;
+        const long k = long(pos);
+        const long next = min(k + 1, count - 1);
+        const double frac = pos - k;
+        for (int c = 0; c < channels; ++c) {
+            const int from = min(c, source - 1);
+            double v = in[k * source + from] * (1 - frac) +
+                       in[next * source + from] * frac;
+            data[i * channels + c] = short(v < 0 ? v - 0.5 : v + 0.5);
+        }
+    }
+    return new YSample(data, int(frames));
+}
+
 /******************************************************************************
  * ALSA audio interface
  ******************************************************************************/
@@ -161,19 +263,15 @@ public:
     YALSAAudio();
     virtual ~YALSAAudio();
 
-    virtual bool play(int sound);
-    virtual int init(SoundConf* conf) {
-        this->conf = conf;
-        return open();
-    }
+    virtual bool write(const short* data, int frames);
+    virtual int init(SoundConf* conf);
     virtual void drain() {
         if (playback_handle)
             snd_pcm_drain(playback_handle);
     }
+    virtual long latency();
 
 private:
-    int open();
-
     SoundConf* conf;
     snd_pcm_t *playback_handle;
 };
@@ -192,105 +290,66 @@ YALSAAudio::~YALSAAudio() {
     }
 }
 
-int YALSAAudio::open() {
+/**
+ * Open the device and negotiate the hardware parameters once.
+ * ALSA converts to the hardware format when it differs.
+ */
+int YALSAAudio::init(SoundConf* conf) {
+    this->conf = conf;
+
     int err;
     if ((err = snd_pcm_open(&playback_handle,
                     conf->alsaDevice(), SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
         warn("cannot open audio device %s (%s)\n",
                  conf->alsaDevice(),
                  snd_strerror(err));
+        playback_handle = 0;
+        return ICESOUND_IF_ERROR;
+    }
+
+    if ((err = snd_pcm_set_params(playback_handle, SND_PCM_FORMAT_S16,
+                    SND_PCM_ACCESS_RW_INTERLEAVED, channels, sampleRate,
+                    1, ALSA_LATENCY)) < 0) {
+        warn("cannot set parameters (%s)\n", snd_strerror(err));
+        snd_pcm_close(playback_handle);
+        playback_handle = 0;
         return ICESOUND_IF_ERROR;
     }
     return ICESOUND_SUCCESS;
 }
 
 /**
- * Play a sound sample directly to the digital signal processor.
+ * Write frames to the device.  An underrun between two sounds
+ * is expected and the stream is prepared again.
  */
-bool YALSAAudio::play(int sound) {
-    csmart samplefile(conf->findSample(sound));
-    if (samplefile == NULL)
-        return false;
-
-    if (conf->verbose())
-        tlog(_("Playing sample #%d (%s)"), sound, (char *) samplefile);
-
-    int err;
-    snd_pcm_hw_params_t *hw_params(0);
-
-    SF_INFO sfinfo = {};
-    SNDFILE* sf = sf_open(samplefile, SFM_READ, &sfinfo);
-    if (sf == NULL) {
-        warn("%s: %s", (char *) samplefile, sf_strerror(sf));
-        goto done;
-    }
-
-    if ((err = snd_pcm_hw_params_malloc(&hw_params)) < 0) {
-        warn("cannot allocate hardware parameter structure (%s)\n",
-                 snd_strerror(err));
-        goto done;
-    }
-
-    if ((err = snd_pcm_hw_params_any(playback_handle, hw_params)) < 0) {
-        warn("cannot initialize hardware parameter structure (%s)\n",
-                 snd_strerror(err));
-        goto done;
-    }
-
-    if ((err = snd_pcm_hw_params_set_access(playback_handle, hw_params,
-                    SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
-        warn("cannot set access type (%s)\n", snd_strerror(err));
-        goto done;
-    }
-
-    if ((err = snd_pcm_hw_params_set_format(playback_handle, hw_params,
-                    SND_PCM_FORMAT_S16_LE)) < 0) {
-        warn("cannot set sample format (%s)\n", snd_strerror(err));
-        goto done;
-    }
-
-    if ((err = snd_pcm_hw_params_set_rate_near(playback_handle, hw_params,
-                    (unsigned int *)&sfinfo.samplerate, 0)) < 0) {
-        warn("cannot set sample rate (%s)\n", snd_strerror(err));
-        goto done;
-    }
-
-    if ((err = snd_pcm_hw_params_set_channels(playback_handle, hw_params,
-                    sfinfo.channels)) < 0) {
-        warn("cannot set channel count (%s)\n", snd_strerror(err));
-        goto done;
-    }
-
-    if ((err = snd_pcm_hw_params(playback_handle, hw_params)) < 0) {
-        warn("cannot set parameters (%s)\n", snd_strerror(err));
-        goto done;
-    }
-
-    if ((err = snd_pcm_prepare(playback_handle)) < 0) {
-        warn("cannot prepare audio interface (%s)\n", snd_strerror(err));
-        goto done;
-    }
-
-    {
-        const int N = 8*1024;
-        short sbuf[N]; // period_size * channels * snd_pcm_format_width(format)) / 8
-        for (int n; (n = sf_readf_short(sf, sbuf, N / 2)) > 0; ) {
-            if ((err = snd_pcm_writei(playback_handle, sbuf, n)) != n) {
-                warn("write to audio interface failed (%s) %zd %d\n",
-                         snd_strerror(err), sizeof(short), n);
-                goto done;
+bool YALSAAudio::write(const short* data, int frames) {
+    while (frames > 0) {
+        snd_pcm_sframes_t n = snd_pcm_writei(playback_handle, data, frames);
+        if (n < 0) {
+            int err = snd_pcm_recover(playback_handle, int(n), 1);
+            if (err < 0) {
+                warn("write to audio interface failed (%s)\n",
+                         snd_strerror(err));
+                return false;
             }
+            continue;
         }
+        data += n * channels;
+        frames -= int(n);
     }
-
-done:
-    if (hw_params)
-        snd_pcm_hw_params_free(hw_params);
-    if (sf)
-        sf_close(sf);
+    // Start a short sound which did not fill the buffer.
+    if (snd_pcm_state(playback_handle) == SND_PCM_STATE_PREPARED)
+        snd_pcm_start(playback_handle);
     return true;
 }
 
+long YALSAAudio::latency() {
+    snd_pcm_uframes_t buffer_size = 0, period_size = 0;
+    if (snd_pcm_get_params(playback_handle, &buffer_size, &period_size) < 0)
+        return 0;
+    return long(1000000.0 * buffer_size / sampleRate);
+}
+
 #endif /* ENABLE_ALSA */
 
 /******************************************************************************
@@ -304,8 +363,9 @@ public:
     YOSSAudio(): conf(0), device(-1) {}
     ~YOSSAudio();
 
-    virtual bool play(int sound);
+    virtual bool write(const short* data, int frames);
     virtual int init(SoundConf* conf);
+    virtual void drain();
 
 private:
     SoundConf* conf;
@@ -313,81 +373,39 @@ private:
 };
 
 /**
- * Play a sound sample directly to the digital signal processor.
+ * Write frames directly to the digital signal processor.
  */
-bool YOSSAudio::play(int sound) {
-    csmart samplefile(conf->findSample(sound));
-    if (samplefile == NULL)
-        return false;
-
-    if (conf->verbose())
-        tlog(_("Playing sample #%d (%s)"), sound, (char *) samplefile);
-
-    SF_INFO sfinfo = {};
-    SNDFILE* sf = sf_open(samplefile, SFM_READ, &sfinfo);
-    if (sf == NULL) {
-        warn("%s: %s", (char *) samplefile, sf_strerror(sf));
-        return false;
-    }
-
-    if (sfinfo.channels < 1 || sfinfo.channels > 2) {
-        warn(_("%s: Invalid number of channels"), (char *) samplefile);
-        sf_close(sf);
-        return false;
-    }
-
-    if (ioctl(device, SNDCTL_DSP_CHANNELS, &sfinfo.channels)) {
-        fail(_("Could not set OSS channels"));
-        goto done;
-    }
-
-    if (ioctl(device, SNDCTL_DSP_SPEED, &sfinfo.samplerate)) {
-        fail(_("Could not set OSS channels"));
-        goto done;
-    }
-
-    if (ioctl(device, SNDCTL_DSP_SYNC, NULL)) {
-        fail(_("Could not sync OSS"));
-        goto done;
-    }
-
-    {
-        const int N = 8*1024;
-        short sbuf[N] = {};
-        const int frames = N / sfinfo.channels;
-        for (int count; (count = sf_readf_short(sf, sbuf, frames)) > 0; ) {
-            int bytes = count * sfinfo.channels * 2;
-            int wrote = write(device, sbuf, bytes);
-            if (wrote == -1) {
-                fail(_("OSS write failed"));
-                goto done;
-            }
-            if (wrote != bytes) {
-                warn(_("OSS incomplete write (%d/%d)"), wrote, bytes);
-                break;
-            }
+bool YOSSAudio::write(const short* data, int frames) {
+    const char* buf = (const char *) data;
+    int bytes = frames * channels * int(sizeof(short));
+    while (bytes > 0) {
+        int wrote = ::write(device, buf, bytes);
+        if (wrote == -1) {
+            if (errno == EINTR)
+                continue;
+            fail(_("OSS write failed"));
+            return false;
         }
+        buf += wrote;
+        bytes -= wrote;
     }
 
     if (ioctl(device, SNDCTL_DSP_POST, NULL)) {
         fail(_("Could not post OSS"));
-        goto done;
+        return false;
     }
+    return true;
+}
 
-    if (ioctl(device, SNDCTL_DSP_SYNC, NULL)) {
+void YOSSAudio::drain() {
+    if (device >= 0 && ioctl(device, SNDCTL_DSP_SYNC, NULL)) {
         fail(_("Could not sync OSS"));
-        goto done;
     }
-
-done:
-    sf_close(sf);
-    return true;
 }
 
 int YOSSAudio::init(SoundConf* conf) {
     this->conf = conf;
     int result = ICESOUND_IF_ERROR;
-    int stereo = 1;
     int format =
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
         AFMT_S16_LE
@@ -403,11 +421,6 @@ int YOSSAudio::init(SoundConf* conf) {
         goto done;
     }
 
-    if (ioctl(device, SNDCTL_DSP_STEREO, &stereo) == -1) {
-        fail(_("Could not set OSS stereo"));
-        goto done;
-    }
-
     if (ioctl(device, SNDCTL_DSP_RESET, NULL) == -1) {
         fail(_("Could not reset OSS DSP"));
         goto done;
@@ -418,6 +431,19 @@ int YOSSAudio::init(SoundConf* conf) {
         goto done;
     }
 
+    if (ioctl(device, SNDCTL_DSP_CHANNELS, &channels) == -1 ||
+        channels < 1 || channels > 2) {
+        fail(_("Could not set OSS channels"));
+        goto done;
+    }
+
+    // The device may choose another rate, to which samples are converted.
+    if (ioctl(device, SNDCTL_DSP_SPEED, &sampleRate) == -1 ||
+        sampleRate < 1) {
+        fail(_("Could not set OSS channels"));
+        goto done;
+    }
+
     result = ICESOUND_SUCCESS;
 done:
     if (device >= 0 && result == ICESOUND_IF_ERROR) {
@@ -448,85 +474,310 @@ class YAOAudio : public YAudioInterface {
 public:
     YAOAudio() :
         conf(0),
-        driver(-1)
+        driver(-1),
+        device(0)
     {
     }
     virtual ~YAOAudio() {
+        if (device)
+            ao_close(device);
         if (conf)
             ao_shutdown();
     }
-    virtual bool play(int sound);
+    virtual bool write(const short* data, int frames);
     virtual int init(SoundConf* conf);
 
 private:
     SoundConf* conf;
     int driver;
+    ao_device* device;
 };
 
+/**
+ * Open the default driver once for the format of all samples.
+ */
 int YAOAudio::init(SoundConf* conf) {
     this->conf = conf;
     ao_initialize();
     driver = ao_default_driver_id();
     if (driver < 0)
         return ICESOUND_IF_ERROR;
+
+    ao_sample_format format = {};
+    format.bits = 16;
+    format.rate = sampleRate;
+    format.channels = channels;
+    format.byte_format = AO_FMT_NATIVE;
+    format.matrix = NULL;
+
+    device = ao_open_live(driver, &format, NULL);
+    if (device == NULL) {
+        warn(_("ao_open_live failed with %d"), errno);
+        return ICESOUND_IF_ERROR;
+    }
     return ICESOUND_SUCCESS;
 }
 
+bool YAOAudio::write(const short* data, int frames) {
+    int bytes = frames * channels * int(sizeof(short));
+    if (ao_play(device, (char *) data, bytes) == 0) {
+        warn(_("ao_play failed"));
+        return false;
+    }
+    return true;
+}
+
+#endif /* ENABLE_AO */
+
+/******************************************************************************
+ * Playback of overlapping samples on a separate thread
+ ******************************************************************************/
+
 /**
- * Play a cached sound sample using ESounD.
+ * The mixer owns the audio device once it runs.  Events queue their
+ * samples without waiting for the device.  The mixer thread sums the
+ * samples which play at the same time, one period at a time, and
+ * drops requests which waited too long or exceed the voice limit.
  */
-bool YAOAudio::play(int sound) {
-    csmart samplefile(conf->findSample(sound));
-    if (samplefile == NULL)
-        return false;
+class YSoundMixer {
+public:
+    YSoundMixer(YAudioInterface* audio, SoundConf* conf);
+    ~YSoundMixer();
 
-    if (conf->verbose())
-        tlog(_("Playing sample #%d (%s)"), sound, (char *) samplefile);
+    bool start();
 
-    ao_device* device = 0;
-    ao_sample_format format = {};
+    /**
+     * Queue a sample for an event which was received at the given time.
+     */
+    void play(const YSample* sample, const char* name, timeval received);
 
-    SF_INFO sfinfo = {};
-    SNDFILE* sf = sf_open(samplefile, SFM_READ, &sfinfo);
-    if (sf == NULL) {
-        warn("%s: %s", (char *) samplefile, sf_strerror(sf));
-        goto done;
+    /**
+     * Free a replaced sample once no voice refers to it anymore.
+     */
+    void retire(YSample* sample);
+
+    /**
+     * Wait until all queued samples have been played.
+     */
+    void drain();
+
+private:
+    struct Voice {
+        const YSample* sample;
+        const char* name;
+        timeval received;
+        int position;           // in frames
+        bool fresh;             // not yet written
+    };
+
+    static void* worker(void* self);
+    void loop();
+    void accept();
+    int mix(short* out, int frames);
+    void report();
+    void release();
+
+    YAudioInterface* const audio;
+    SoundConf* const conf;
+    YArray<Voice> requests;
+    YArray<Voice> voices;
+    YArray<YSample*> retired;
+    asmart<int> sums;
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeup;
+    pthread_cond_t idle;
+    pthread_t thread;
+    bool started;
+    bool running;
+    bool busy;
+};
+
+YSoundMixer::YSoundMixer(YAudioInterface* audio, SoundConf* conf) :
+    audio(audio),
+    conf(conf),
+    sums(new int[MIXER_PERIOD * audio->channelCount()]),
+    started(false),
+    running(true),
+    busy(false)
+{
+    pthread_mutex_init(&mutex, 0);
+    pthread_cond_init(&wakeup, 0);
+    pthread_cond_init(&idle, 0);
+}
+
+YSoundMixer::~YSoundMixer() {
+    if (started) {
+        pthread_mutex_lock(&mutex);
+        running = false;
+        pthread_cond_signal(&wakeup);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(thread, 0);
     }
+    release();
+    pthread_cond_destroy(&idle);
+    pthread_cond_destroy(&wakeup);
+    pthread_mutex_destroy(&mutex);
+}
 
-    format.bits = 16;
-    format.rate = sfinfo.samplerate;
-    format.channels = sfinfo.channels;
-    format.byte_format = AO_FMT_LITTLE;
-    format.matrix = NULL;
+/**
+ * Start the mixer thread, which leaves all signals to the main thread.
+ */
+bool YSoundMixer::start() {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    started = (pthread_create(&thread, 0, worker, this) == 0);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+    if (started == false)
+        warn(_("Could not start the sound mixer; playing synchronously"));
+    return started;
+}
 
-    device = ao_open_live(driver, &format, NULL);
-    if (device == NULL) {
-        warn(_("ao_open_live failed with %d"), errno);
-        goto done;
+void* YSoundMixer::worker(void* self) {
+    static_cast<YSoundMixer*>(self)->loop();
+    return 0;
+}
+
+void YSoundMixer::play(const YSample* sample, const char* name,
+                       timeval received) {
+    if (started == false) {
+        audio->write(sample->data, sample->frames);
+        return;
     }
+    Voice voice = { sample, name, received, 0, true };
+    pthread_mutex_lock(&mutex);
+    requests.append(voice);
+    pthread_cond_signal(&wakeup);
+    pthread_mutex_unlock(&mutex);
+}
 
-    {
-        const int N = 8*1024;
-        short sbuf[N] = {};
-        const int frames = N / format.channels;
-        for (int n, k; (n = sf_readf_short(sf, sbuf, frames)) > 0; ) {
-            k = ao_play(device, (char *) sbuf, n * 2 * format.channels);
-            if (k == 0) {
-                warn(_("ao_play failed"));
-                goto done;
-            }
+void YSoundMixer::retire(YSample* sample) {
+    if (started == false) {
+        delete sample;
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    if (busy || requests.nonempty())
+        retired.append(sample);
+    else
+        delete sample;
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Free the retired samples, when no voice is playing.
+ */
+void YSoundMixer::release() {
+    for (int i = 0; i < retired.getCount(); ++i)
+        delete retired[i];
+    retired.clear();
+}
+
+void YSoundMixer::drain() {
+    pthread_mutex_lock(&mutex);
+    while (started && (busy || requests.nonempty()))
+        pthread_cond_wait(&idle, &mutex);
+    pthread_mutex_unlock(&mutex);
+    audio->drain();
+}
+
+/**
+ * Move queued requests to the playing voices.  Requests which are
+ * older than the maximum age or exceed the voice limit are dropped.
+ */
+void YSoundMixer::accept() {
+    if (requests.isEmpty())
+        return;
+
+    timeval now = monotime();
+    for (int i = 0; i < requests.getCount(); ++i) {
+        const Voice& voice = requests[i];
+        if (millitime(conf->maxAge()) < now - voice.received) {
+            if (conf->verbose())
+                tlog(_("Too late; dropping %s."), voice.name);
+        }
+        else if (voices.getCount() >= conf->voiceLimit()) {
+            if (conf->verbose())
+                tlog(_("Too many voices; dropping %s."), voice.name);
+        }
+        else {
+            voices.append(voice);
         }
     }
+    requests.shrink(0);
+}
 
-done:
-    if (device)
-        ao_close(device);
-    if (sf)
-        sf_close(sf);
-    return true;
+/**
+ * Sum the next frames of all voices with saturation.
+ * Returns the number of frames, which is at most the given count.
+ */
+int YSoundMixer::mix(short* out, int count) {
+    const int channels = audio->channelCount();
+    int frames = 0;
+    for (int i = 0; i < voices.getCount(); ++i)
+        frames = max(frames, min(count,
+                     voices[i].sample->frames - voices[i].position));
+
+    const int length = frames * channels;
+    memset(sums, 0, length * sizeof(int));
+    for (int i = voices.getCount(); --i >= 0; ) {
+        Voice& voice = voices[i];
+        const int n = min(frames, voice.sample->frames - voice.position);
+        const short* data = voice.sample->data + voice.position * channels;
+        for (int k = 0; k < n * channels; ++k)
+            sums[k] += data[k];
+        voice.position += n;
+    }
+    for (int k = 0; k < length; ++k)
+        out[k] = short(clamp(sums[k], -32768, 32767));
+    return frames;
 }
 
-#endif /* ENABLE_AO */
+/**
+ * Print the latency of the voices which were just written.
+ */
+void YSoundMixer::report() {
+    timeval now = monotime();
+    for (int i = 0; i < voices.getCount(); ++i) {
+        if (voices[i].fresh) {
+            voices[i].fresh = false;
+            if (conf->latency())
+                tlog(_("%s: written after %.3f ms, device latency %.1f ms"),
+                     voices[i].name,
+                     1e3 * toDouble(now - voices[i].received),
+                     1e-3 * audio->latency());
+        }
+    }
+}
+
+void YSoundMixer::loop() {
+    asmart<short> buffer(new short[MIXER_PERIOD * audio->channelCount()]);
+
+    pthread_mutex_lock(&mutex);
+    while (running) {
+        accept();
+        if (voices.isEmpty()) {
+            busy = false;
+            release();
+            pthread_cond_broadcast(&idle);
+            pthread_cond_wait(&wakeup, &mutex);
+            continue;
+        }
+        busy = true;
+
+        int frames = mix(buffer, MIXER_PERIOD);
+        pthread_mutex_unlock(&mutex);
+        audio->write(buffer, frames);
+        pthread_mutex_lock(&mutex);
+
+        report();
+        for (int i = voices.getCount(); --i >= 0; ) {
+            if (voices[i].position >= voices[i].sample->frames)
+                voices.remove(i);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
 
 /******************************************************************************
  * IceSound application
@@ -549,6 +800,9 @@ public:
     virtual const char* esdServer() const {
         return esdServerName ? esdServerName : getenv("ESPEAKER");
     }
+    virtual bool latency() const { return latencyMode; }
+    virtual int voiceLimit() const { return voices; }
+    virtual long maxAge() const { return maxAgeTime; }
     virtual char* findSample(int sound) const;
 
     int run();
@@ -563,13 +817,19 @@ private:
     char const* esdServerName;
     char const* displayName;
     char const* interfaceNames;
+    bool latencyMode;
     class YAudioInterface* audio;
+    class YSoundMixer* mixer;
+    YSample* samples[NUM_GUI_EVENTS];
     upath paths[6];
     Atom _GUI_EVENT;
     Display* display;
     Window root;
     timeval last;
+    timeval received;
     long snooze;
+    long maxAgeTime;
+    int voices;
 
     const char* name(int sound) const {
         return gui_event_names[sound];
@@ -577,6 +837,10 @@ private:
     void initPaths();
     void initSignals();
     int chooseInterface();
+    void loadSample(int sound);
+    void loadSamples();
+    void freeSamples();
+    bool play(int sound);
     void loopEvents();
     void readEvents();
     void guiEvent();
@@ -598,13 +862,20 @@ IceSound::IceSound(int argc, char** argv) :
     esdServerName(0),
     displayName(0),
     interfaceNames(audio_interfaces),
+    latencyMode(false),
     audio(0),
+    mixer(0),
     _GUI_EVENT(None),
     display(NULL),
     root(None),
     last(zerotime()),
-    snooze(DEFAULT_SNOOZE_TIME)
+    received(zerotime()),
+    snooze(DEFAULT_SNOOZE_TIME),
+    maxAgeTime(DEFAULT_MAX_AGE),
+    voices(DEFAULT_VOICES)
 {
+    for (int i = 0; i < NUM_GUI_EVENTS; ++i)
+        samples[i] = 0;
 #ifdef DEBUG
     verbosity = true;
 #endif
@@ -638,9 +909,20 @@ IceSound::IceSound(int argc, char** argv) :
                 long t = strtol(value, NULL, 10);
                 if (t > 0) snooze = t;
             }
+            else if (GetArgument(value, "m", "max-age", arg, argv + argc)) {
+                long t = strtol(value, NULL, 10);
+                if (t > 0) maxAgeTime = t;
+            }
+            else if (GetArgument(value, "n", "voices", arg, argv + argc)) {
+                long n = strtol(value, NULL, 10);
+                if (n > 0) voices = int(min(n, 64L));
+            }
             else if (is_switch(*arg, "v", "verbose")) {
                 verbosity = true;
             }
+            else if (is_long_switch(*arg, "latency")) {
+                latencyMode = true;
+            }
             else if (is_help_switch(*arg)) {
                 printUsage();
             }
@@ -712,6 +994,12 @@ Options:\n\
 \n\
  -z, --snooze=millisecs  Specifies the snooze interval between sound events\n\
                          in milliseconds. Default is 500 milliseconds.\n\
+\n\
+ -m, --max-age=millisecs Drops sound events which could not start playing\n\
+                         within this time. Default is 250 milliseconds.\n\
+\n\
+ -n, --voices=count      Specifies how many sounds may play at the same time.\n\
+                         Default is 4.\n\
 \n\
  -p, --play=sound        Plays the given sound (name or number) and exits.\n\
 \n\
@@ -722,6 +1010,8 @@ Options:\n\
      --list-interfaces   Lists the supported audio interfaces and exits.\n\
 \n\
  -v, --verbose           Be verbose and print out each sound event.\n\
+\n\
+     --latency           Print the latency of each sound event.\n\
 \n\
  -V, --version           Prints version information and exits.\n\
 \n\
@@ -782,6 +1072,64 @@ char* IceSound::findSample(int sound) const {
     return NULL;
 }
 
+/**
+ * Decode the sample for a gui event in the format of the audio device.
+ */
+void IceSound::loadSample(int sound) {
+    if (mixer && samples[sound])
+        mixer->retire(samples[sound]);
+    else
+        delete samples[sound];
+    samples[sound] = 0;
+    csmart samplefile(findSample(sound));
+    if (samplefile)
+        samples[sound] = YSample::load(samplefile,
+                                       audio->rate(), audio->channelCount());
+}
+
+/**
+ * Decode all samples, on startup and when reloading.
+ */
+void IceSound::loadSamples() {
+    timeval start = monotime();
+    int count = 0, bytes = 0;
+    for (int i = 0; i < NUM_GUI_EVENTS; ++i) {
+        if (i != geCloseAll) {
+            loadSample(i);
+            if (samples[i]) {
+                count += 1;
+                bytes += samples[i]->frames * audio->channelCount() * 2;
+            }
+        }
+    }
+    if (verbose() || latencyMode)
+        tlog(_("Loaded %d samples of %d KB in %.1f ms"),
+             count, bytes / 1024, 1e3 * toDouble(monotime() - start));
+}
+
+void IceSound::freeSamples() {
+    for (int i = 0; i < NUM_GUI_EVENTS; ++i) {
+        delete samples[i];
+        samples[i] = 0;
+    }
+}
+
+/**
+ * Play the sample for the given event.
+ * Return true iff the sound is playable.
+ */
+bool IceSound::play(int sound) {
+    YSample* sample = samples[sound];
+    if (sample == NULL)
+        return false;
+
+    if (verbose())
+        tlog(_("Playing sample #%d (%s)"), sound, name(sound));
+
+    mixer->play(sample, name(sound), received);
+    return true;
+}
+
 /**
  * The hearth of icesound
  */
@@ -790,6 +1138,9 @@ int IceSound::run() {
 
     int rc = chooseInterface();
     if (rc) return rc;
+    loadSamples();
+    mixer = new YSoundMixer(audio, this);
+    mixer->start();
 
     if (NULL == (display = XOpenDisplay(displayName))) { // === connect to X11 ===
         warn(_("Can't open display: %s. X must be running and $DISPLAY set."),
@@ -804,6 +1155,9 @@ int IceSound::run() {
         XCloseDisplay(display);
         display = NULL;
     }
+    delete mixer;
+    mixer = NULL;
+    freeSamples();
     delete audio;
     audio = NULL;
     return rc;
@@ -814,6 +1168,10 @@ void IceSound::loopEvents() {
     fd_set rfds;
     FD_ZERO(&rfds);
     for (readEvents(); soundAsync.running; readEvents()) {
+        if (soundAsync.reload) {
+            soundAsync.reload = false;
+            loadSamples();
+        }
         FD_SET(fd, &rfds);
         select(fd + 1, SELECT_TYPE_ARG234 &rfds, NULL, NULL, NULL);
     }
@@ -824,6 +1182,7 @@ void IceSound::readEvents() {
         XEvent xev;
         xev.type = 0;
         XNextEvent(display, &xev);
+        received = monotime();
         if (xev.type == PropertyNotify &&
             xev.xproperty.atom == _GUI_EVENT &&
             xev.xproperty.state == PropertyNewValue)
@@ -872,7 +1231,7 @@ void IceSound::guiEvent() {
 
     timeval now = monotime();
     if (last + millitime(snooze) < now || gev == geStartup) {
-        if (audio->play(gev))
+        if (play(gev))
             last = now;
     }
     else if (verbose())
@@ -963,9 +1322,15 @@ void IceSound::playOnce(char* value) {
     }
     if (inrange(sound, 0, NUM_GUI_EVENTS - 1)) {
         if (chooseInterface() == ICESOUND_SUCCESS) {
-            if (audio->play(sound)) {
-                audio->drain();
+            received = monotime();
+            loadSample(sound);
+            mixer = new YSoundMixer(audio, this);
+            mixer->start();
+            if (play(sound)) {
+                mixer->drain();
             }
+            delete mixer; mixer = 0;
+            freeSamples();
             delete audio; audio = 0;
         }
     }
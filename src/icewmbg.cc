@@ -5,8 +5,10 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "yfull.h"
 #include "yxapp.h"
+#include "yimage.h"
 #include "yprefs.h"
 #include "ypaths.h"
 #include "ytimer.h"
@@ -129,8 +131,187 @@ public:
             pixes[k]->unload();
         }
     }
+    void unload(mstring name) {
+        int k = find(name);
+        if (k >= 0) {
+            pixes[k]->unload();
+        }
+    }
 };
 
+// Backgrounds which were rendered for the desktop, most recently used last.
+// Each is identified by image file, modification time, color and layout.
+class Renderings {
+public:
+    typedef ref<YPixmap> Pixmap;
+
+    Renderings(): pixels(0) { }
+    ~Renderings() { clear(); }
+
+    Pixmap find(mstring name, time_t stamp, unsigned long color,
+                unsigned long layout, bool* stale);
+    void add(mstring name, time_t stamp, unsigned long color,
+             unsigned long layout, Pixmap pixmap, unsigned long budget);
+    void show(Pixmap background, Pixmap transparency) {
+        shown[0] = background;
+        shown[1] = transparency;
+    }
+    void clear() {
+        list.clear();
+        pixels = 0;
+        shown[0] = null;
+        shown[1] = null;
+    }
+
+private:
+    struct Rendering {
+        Rendering(mstring n, time_t t, unsigned long c, unsigned long l,
+                  Pixmap p):
+            name(n), stamp(t), color(c), layout(l), pixmap(p) { }
+        unsigned long size() const {
+            return (unsigned long) pixmap->width() * pixmap->height();
+        }
+        mstring name;
+        time_t stamp;
+        unsigned long color;
+        unsigned long layout;
+        Pixmap pixmap;
+    };
+    YObjectArray<Rendering> list;
+    unsigned long pixels;
+    Pixmap shown[2];
+
+    bool keep(int k) const {
+        return k == list.getCount() - 1 ||
+            list[k]->pixmap == shown[0] || list[k]->pixmap == shown[1];
+    }
+    void remove(int k) {
+        pixels -= list[k]->size();
+        list.remove(k);
+    }
+};
+
+Renderings::Pixmap Renderings::find(mstring name, time_t stamp,
+                                    unsigned long color, unsigned long layout,
+                                    bool* stale)
+{
+    *stale = false;
+    for (int k = list.getCount(); --k >= 0; ) {
+        Rendering* r = list[k];
+        if (r->color == color && r->layout == layout && r->name == name) {
+            if (r->stamp != stamp) {
+                *stale = true;
+                remove(k);
+                break;
+            }
+            for (int i = k + 1; i < list.getCount(); ++i) {
+                list.swap(i - 1, i);
+            }
+            return r->pixmap;
+        }
+    }
+    return null;
+}
+
+// Release the least recently used renderings which exceed the budget,
+// but never the newest one or those which are on display.
+void Renderings::add(mstring name, time_t stamp, unsigned long color,
+                     unsigned long layout, Pixmap pixmap,
+                     unsigned long budget)
+{
+    list.append(new Rendering(name, stamp, color, layout, pixmap));
+    pixels += list[list.getCount() - 1]->size();
+
+    for (int k = 0; pixels > budget && k < list.getCount(); ) {
+        if (keep(k))
+            ++k;
+        else
+            remove(k);
+    }
+}
+
+// Scale one image to several sizes on worker threads.
+// Only the main thread talks to the X server: it fetches the source
+// image beforehand and uploads the results afterwards.
+class ScaleJobs {
+public:
+    explicit ScaleJobs(ref<YPixmap> pixmap): source(pixmap), next(0) { }
+    ~ScaleJobs() { jobs.clear(); image = null; }
+
+    int add(unsigned width, unsigned height);
+    void run();
+    ref<YPixmap> result(int job, unsigned depth);
+
+private:
+    struct Job {
+        Job(unsigned w, unsigned h): width(w), height(h) { }
+        unsigned width, height;
+        ref<YImage> scaled;
+        ref<YPixmap> pixmap;
+    };
+    ref<YPixmap> source;
+    ref<YImage> image;
+    YObjectArray<Job> jobs;
+    int next;
+
+    void work();
+    static void* worker(void* self) {
+        static_cast<ScaleJobs*>(self)->work();
+        return 0;
+    }
+};
+
+int ScaleJobs::add(unsigned width, unsigned height) {
+    for (int k = 0; k < jobs.getCount(); ++k) {
+        if (jobs[k]->width == width && jobs[k]->height == height) {
+            return k;
+        }
+    }
+    jobs.append(new Job(width, height));
+    return jobs.getCount() - 1;
+}
+
+void ScaleJobs::work() {
+    for (int k; (k = __sync_fetch_and_add(&next, 1)) < jobs.getCount(); ) {
+        jobs[k]->scaled = image->scale(jobs[k]->width, jobs[k]->height);
+    }
+}
+
+void ScaleJobs::run() {
+    if (jobs.getCount() == 0)
+        return;
+    image = YImage::createFromPixmap(source);
+    if (image == null)
+        return;
+
+    // Lazily created visuals must exist before the workers need them.
+    xapp->visualForDepth(32);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = int(min(long(jobs.getCount()), max(1L, min(cpus, 8L)))) - 1;
+    pthread_t* threads = new pthread_t[count + 1];
+    int started = 0;
+    for (; started < count; ++started) {
+        if (pthread_create(&threads[started], 0, worker, this))
+            break;
+    }
+    work();
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], 0);
+    }
+    delete[] threads;
+    image = null;
+}
+
+ref<YPixmap> ScaleJobs::result(int job, unsigned depth) {
+    Job* j = jobs[job];
+    if (j->pixmap == null && j->scaled != null) {
+        j->pixmap = YPixmap::createFromImage(j->scaled, depth);
+        j->scaled = null;
+    }
+    return j->pixmap != null ? j->pixmap : source;
+}
+
 class Background: public YXApplication, private YTimerListener {
 public:
     Background(int *argc, char ***argv, bool verbose = false);
@@ -193,9 +374,12 @@ private:
 
     void addImage(Strings& images, const char* name, bool append);
     ref<YPixmap> renderBackground(ref<YPixmap> back, YColor color);
-    ref<YPixmap> getBackgroundPixmap();
+    ref<YPixmap> render(mstring name, YColor color);
+    unsigned long layout() const;
+    void prerender();
+    ref<YPixmap> getBackgroundPixmap(YColor color, int cycle, cstring* name);
     YColor getBackgroundColor();
-    ref<YPixmap> getTransparencyPixmap();
+    ref<YPixmap> getTransparencyPixmap(YColor color);
     YColor getTransparencyColor();
     Atom atom(const char* name) const;
     static Window window() { return desktop->handle(); }
@@ -210,6 +394,7 @@ private:
     Strings transparencyImages;
     YColors transparencyColors;
     PixCache cache;
+    Renderings renderings;
     upath themeDir;
     int activeWorkspace;
     int cycleOffset;
@@ -221,6 +406,7 @@ private:
     cstring pixmapName;
     YArray<int> sequence;
     lazy<YTimer> cycleTimer;
+    lazy<YTimer> prerenderTimer;
 
     Atom _XA_XROOTPMAP_ID;
     Atom _XA_XROOTCOLOR_PIXEL;
@@ -316,6 +502,7 @@ Background::~Background() {
     clearBackgroundColors();
     clearTransparencyImages();
     clearTransparencyColors();
+    renderings.clear();
     cache.clear();
 }
 
@@ -466,18 +653,25 @@ bool Background::handleTimer(YTimer* timer) {
         cache.unload();
         update(true);
     }
+    if (timer == prerenderTimer) {
+        prerender();
+        return false;
+    }
     return true;
 }
 
-ref<YPixmap> Background::getBackgroundPixmap() {
+ref<YPixmap> Background::getBackgroundPixmap(YColor color, int cycle,
+                                             cstring* name)
+{
     ref<YPixmap> pixmap;
     int count = backgroundImages.getCount();
     if (count > 0 && activeWorkspace >= 0) {
         for (int i = 0; i < count; ++i) {
-            int k = shuffle((i + activeWorkspace + cycleOffset) % count);
-            pixmap = cache.get(backgroundImages[k]);
+            int k = shuffle((i + activeWorkspace + cycle) % count);
+            pixmap = render(backgroundImages[k], color);
             if (pixmap != null) {
-                pixmapName = backgroundImages[k];
+                if (name)
+                    *name = backgroundImages[k];
                 break;
             }
         }
@@ -492,14 +686,14 @@ YColor Background::getBackgroundColor() {
         : YColor::black;
 }
 
-ref<YPixmap> Background::getTransparencyPixmap() {
+ref<YPixmap> Background::getTransparencyPixmap(YColor color) {
     ref<YPixmap> pixmap;
     int count = transparencyImages.getCount();
     int numbg = backgroundImages.getCount();
     if (count > 0 && numbg > 0 && activeWorkspace >= 0) {
         for (int i = 0; i < count; ++i) {
             int k = shuffle((i + activeWorkspace + cycleOffset) % numbg) % count;
-            pixmap = cache.get(transparencyImages[k]);
+            pixmap = render(transparencyImages[k], color);
             if (pixmap != null)
                 break;
         }
@@ -656,6 +850,15 @@ ref<YPixmap> Background::renderBackground(ref<YPixmap> back, YColor color) {
     }
     bool zeroDone(false);
 
+    struct Place {
+        int x, y;
+        unsigned width, height, bw, bh;
+        int job;
+    };
+    Place* places = new Place[numScreens];
+    int placeCount = 0;
+    ScaleJobs scaling(back);
+
     for (int screen = 0; screen < numScreens; ++screen) {
         int x(0), y(0);
         if (numScreens > 1) {
@@ -694,29 +897,94 @@ ref<YPixmap> Background::renderBackground(ref<YPixmap> back, YColor color) {
             }
         }
 
-        ref<YPixmap> scaled;
+        Place& place = places[placeCount++];
+        place.x = x;
+        place.y = y;
+        place.width = width;
+        place.height = height;
+        place.bw = bw;
+        place.bh = bh;
+        place.job = -1;
         if (bw != back->width() || bh != back->height()) {
-            scaled = back->scale(bw, bh);
+            place.job = scaling.add(bw, bh);
         }
-        if (scaled == null) {
-            scaled = back;
-        }
-        g.drawPixmap(scaled,
-                     max(0, int(bw - width) / 2),
-                     max(0, int(bh - height) / 2),
-                     min(width, bw),
-                     min(height, bh),
-                     max(x, x + int(width - bw) / 2),
-                     max(y, y + int(height - bh) / 2));
     }
+
+    scaling.run();
+
+    for (int i = 0; i < placeCount; ++i) {
+        const Place& p = places[i];
+        ref<YPixmap> scaled(p.job >= 0
+                            ? scaling.result(p.job, back->depth())
+                            : back);
+        g.drawPixmap(scaled,
+                     max(0, int(p.bw - p.width) / 2),
+                     max(0, int(p.bh - p.height) / 2),
+                     min(p.width, p.bw),
+                     min(p.height, p.bh),
+                     max(p.x, p.x + int(p.width - p.bw) / 2),
+                     max(p.y, p.y + int(p.height - p.bh) / 2));
+    }
+    delete[] places;
     back = cBack;
 
     return back;
 }
 
+// A signature of the screen layout and the rendering preferences.
+unsigned long Background::layout() const {
+    unsigned long shape = desktopWidth * 65599UL + desktopHeight;
+    int numScreens = desktop->getScreenCount();
+    for (int screen = 0; screen < numScreens; ++screen) {
+        int x(0), y(0);
+        unsigned w(0), h(0);
+        desktop->getScreenGeometry(&x, &y, &w, &h, screen);
+        shape = ((shape * 65599UL + unsigned(x)) * 65599UL + unsigned(y))
+              * 65599UL + w * 65599UL + h;
+    }
+    return shape * 8 + scaleBackground + centerBackground * 2
+                     + multiheadBackground * 4;
+}
+
+// Render an image for the desktop, or reuse an earlier rendering.
+ref<YPixmap> Background::render(mstring name, YColor color) {
+    upath path(name);
+    struct stat st;
+    time_t stamp = path.stat(&st) == 0 ? st.st_mtime : 0;
+    unsigned long pixel = color.pixel();
+    unsigned long shape = layout();
+    bool stale = false;
+
+    ref<YPixmap> pixmap(renderings.find(name, stamp, pixel, shape, &stale));
+    if (pixmap != null) {
+        if (verbose) tlog("reuse %s", cstring(name).c_str());
+        return pixmap;
+    }
+    if (stale) {
+        cache.unload(name);
+    }
+    ref<YPixmap> source(cache.get(name));
+    if (source != null) {
+        pixmap = renderBackground(source, color);
+        if (pixmap != null && pixmap != source) {
+            unsigned long budget = (unsigned long) backgroundCacheSize
+                                 * desktopWidth * desktopHeight;
+            renderings.add(name, stamp, pixel, shape, pixmap, budget);
+        }
+    }
+    return pixmap;
+}
+
+// Render the background which the next cycle will show.
+void Background::prerender() {
+    if (verbose) tlog("prerender");
+    getBackgroundPixmap(getBackgroundColor(), cycleOffset + desktopCount, 0);
+}
+
 void Background::changeBackground(bool force) {
-    ref<YPixmap> backgroundPixmap = getBackgroundPixmap();
     YColor backgroundColor(getBackgroundColor());
+    ref<YPixmap> backgroundPixmap =
+        getBackgroundPixmap(backgroundColor, cycleOffset, &pixmapName);
     if (force == false) {
         if (backgroundPixmap == currentBackgroundPixmap &&
             backgroundColor == currentBackgroundColor) {
@@ -726,7 +994,7 @@ void Background::changeBackground(bool force) {
     unsigned long const bPixel(backgroundColor.pixel());
     bool handleBackground(false);
     Pixmap bPixmap(None);
-    ref<YPixmap> back = renderBackground(backgroundPixmap, backgroundColor);
+    ref<YPixmap> back = backgroundPixmap;
 
     if (back != null) {
         bPixmap = back->pixmap();
@@ -747,12 +1015,8 @@ void Background::changeBackground(bool force) {
             _XA_XROOTCOLOR_PIXEL)
         {
             YColor tColor(getTransparencyColor());
-            ref<YPixmap> trans = getTransparencyPixmap();
-            bool samePixmap = trans == backgroundPixmap;
-            bool sameColor = tColor == backgroundColor;
-            currentTransparencyPixmap =
-                trans == null || (samePixmap && sameColor) ? back :
-                renderBackground(trans, tColor);
+            ref<YPixmap> trans = getTransparencyPixmap(tColor);
+            currentTransparencyPixmap = trans == null ? back : trans;
 
             unsigned long tPixel(tColor.pixel());
             Pixmap tPixmap(currentTransparencyPixmap != null
@@ -775,6 +1039,13 @@ void Background::changeBackground(bool force) {
     }
     currentBackgroundPixmap = backgroundPixmap;
     currentBackgroundColor = backgroundColor;
+    renderings.show(currentBackgroundPixmap, currentTransparencyPixmap);
+
+    if (cycleBackgroundsPrerender && 0 < cycleBackgroundsPeriod &&
+        1 < backgroundImages.getCount())
+    {
+        prerenderTimer->setTimer(250L, this, true);
+    }
 }
 
 void Background::restart() const {
@@ -923,6 +1194,8 @@ static const char* get_help_text() {
     " DesktopTransparencyImage - Semitransparency background image(s)\n"
     " DesktopBackgroundMultihead - One background over all monitors\n"
     " CycleBackgroundsPeriod   - Seconds between cycling over backgrounds\n"
+    " CycleBackgroundsPrerender - Render the next cycle background ahead\n"
+    " DesktopBackgroundCacheSize - Desktop-sized backgrounds to keep rendered\n"
     "\n"
     " center:0 scaled:0 = tiled\n"
     " center:1 scaled:0 = centered\n"
@@ -13,6 +13,8 @@ XIV(bool, multiheadBackground, false)
 XIV(bool, supportSemitransparency, true)
 XIV(bool, shuffleBackgroundImages, false)
 XIV(int, cycleBackgroundsPeriod, 0)
+XIV(bool, cycleBackgroundsPrerender, false)
+XIV(int, backgroundCacheSize, 4)
 
 void addBgImage(const char *name, const char *value, bool append);
 
@@ -47,6 +49,12 @@ cfoption icewmbg_prefs[] = {
     OIV("CycleBackgroundsPeriod",  &cycleBackgroundsPeriod, 0, INT_MAX,
         "Seconds between cycling over all background images, default zero is off"),
 
+    OBV("CycleBackgroundsPrerender",  &cycleBackgroundsPrerender,
+        "Render the next background of the cycle ahead of time"),
+
+    OIV("DesktopBackgroundCacheSize",  &backgroundCacheSize, 0, 64,
+        "Number of desktop-sized rendered backgrounds to keep for reuse"),
+
     OK0()
 };
 
@@ -10,9 +10,22 @@
 #include "prefs.h"
 #include "wmtaskbar.h"
 #include "intl.h"
+#include "yrectgrid.h"
 
 extern YColorName activeBorderBg;
 
+lazy<YTimer> YFrameWindow::fMotionTimer;
+
+// The latest pointer motion of an opaque move or resize which is not
+// yet applied, and when the previous motion was applied.
+static XMotionEvent pendingMotion;
+static bool motionPending;
+static timeval motionApplied;
+
+static unsigned long motionEvents;
+static unsigned long motionUpdates;
+static unsigned long motionSkips;
+
 void YFrameWindow::snapTo(int &wx, int &wy,
                           int rx1, int ry1, int rx2, int ry2,
                           int &flags)
@@ -99,10 +112,8 @@ void YFrameWindow::snapTo(int &wx, int &wy,
 }
 
 void YFrameWindow::snapTo(int &wx, int &wy) {
-    YFrameWindow *f = manager->topLayer();
     int flags = 1 | 2;
     int xp = wx, yp = wy;
-    int rx1, ry1, rx2, ry2;
 
     int mx, my, Mx, My;
     manager->getWorkArea(this, &mx, &my, &Mx, &My, getScreen());
@@ -150,19 +161,19 @@ void YFrameWindow::snapTo(int &wx, int &wy) {
     flags &= ~4;
 
     if (flags & (1 | 2)) {
-        for (; f; f = f->nextLayer()) {
-            if (affectsWorkArea() && f->inWorkArea())
-                continue;
-
-            if (f != this && f->visible()) {
-                rx1 = f->x();
-                ry1 = f->y();
-                rx2 = f->x() + f->width();
-                ry2 = f->y() + f->height();
-                snapTo(xp, yp, rx1, ry1, rx2, ry2, flags);
-                if (!(flags & (1 | 2)))
-                    break;
-            }
+        // Only frames within twice the snap distance can be reached,
+        // because each snap moves the frame by at most that distance.
+        const YRectGrid& grid = manager->snapGrid(this);
+        const int d = 2 * max(0, snapDistance) + 1;
+        YArray<int> near;
+        grid.find(YRect(xp - d, yp - d, width() + 2 * d, height() + 2 * d),
+                  near);
+        for (int k = 0; k < near.getCount(); ++k) {
+            const YRect& r = grid[near[k]];
+            snapTo(xp, yp, r.x(), r.y(),
+                   r.x() + int(r.width()), r.y() + int(r.height()), flags);
+            if (!(flags & (1 | 2)))
+                break;
         }
     }
     wx = xp;
@@ -642,6 +653,7 @@ end:
     moveWindow(xx, yy);
     xapp->releaseEvents();
     XUngrabServer(xapp->display());
+    manager->releaseSnapGrid();
 }
 
 bool YFrameWindow::handleKey(const XKeyEvent &key) {
@@ -880,6 +892,7 @@ void YFrameWindow::startMoveSize(bool doMove, bool byMouse,
                                  int mouseXroot, int mouseYroot) {
     Cursor grabPointer = None;
 
+    manager->releaseSnapGrid();
     grabX = sideX;
     grabY = sideY;
     origX = x();
@@ -962,6 +975,9 @@ void YFrameWindow::startMoveSize(bool doMove, bool byMouse,
 }
 
 void YFrameWindow::endMoveSize() {
+    if (fMotionTimer)
+        fMotionTimer->stopTimer();
+    motionPending = false;
     xapp->releaseEvents();
     statusMoveSize->end();
 
@@ -973,6 +989,7 @@ void YFrameWindow::endMoveSize() {
     sizingWindow = false;
 
     manager->setWorkAreaMoveWindows(false);
+    manager->releaseSnapGrid();
 
     if (taskBar) {
         taskBar->workspacesRepaint();
@@ -1054,6 +1071,7 @@ void YFrameWindow::handleButton(const XButtonEvent &button) {
         }
     } else if (button.type == ButtonRelease) {
         if (movingWindow || sizingWindow) {
+            applyMotion();
             endMoveSize();
             return ;
         }
@@ -1061,29 +1079,86 @@ void YFrameWindow::handleButton(const XButtonEvent &button) {
     YWindow::handleButton(button);
 }
 
-void YFrameWindow::handleMotion(const XMotionEvent &motion) {
+// The milliseconds until the next update of a move or resize is due.
+long YFrameWindow::motionDelay() {
+    int rate = moveSizeRate;
+    if (rate <= 0)
+        rate = desktop->refreshRate();
+    if (rate <= 0)
+        rate = 60;
+
+    timeval since = monotime() - motionApplied;
+    long usec = 1000000L / rate - (since.tv_sec > 1 ? 1000000L :
+                since.tv_sec * 1000000L + since.tv_usec);
+    return usec > 0 ? (usec + 999) / 1000 : 0;
+}
+
+void YFrameWindow::applyMotion() {
+    if (motionPending == false)
+        return;
+    motionPending = false;
+    motionApplied = monotime();
+
+    const XMotionEvent &motion = pendingMotion;
     if (sizingWindow) {
         int newX = x(), newY = y();
         int newWidth = width(), newHeight = height();
 
         handleResizeMouse(motion, newX, newY, newWidth, newHeight);
+        if (geometry() == YRect(newX, newY, newWidth, newHeight)) {
+            ++motionSkips;
+            return ;
+        }
+        ++motionUpdates;
 
         drawMoveSizeFX(x(), y(), width(), height());
         setCurrentGeometryOuter(YRect(newX, newY, newWidth, newHeight));
         drawMoveSizeFX(x(), y(), width(), height());
 
         statusMoveSize->setStatus(this);
-        return ;
     } else if (movingWindow) {
         int newX = x();
         int newY = y();
 
         handleMoveMouse(motion, newX, newY);
+        if (newX == x() && newY == y()) {
+            ++motionSkips;
+            return ;
+        }
+        ++motionUpdates;
+
         moveWindow(newX, newY);
+    }
+}
+
+// Motion is applied at most at the update rate; the motion which
+// arrives in between replaces the pending one.
+void YFrameWindow::handleMotion(const XMotionEvent &motion) {
+    if (sizingWindow || movingWindow) {
+        ++motionEvents;
+        pendingMotion = motion;
+        motionPending = true;
+
+        long delay = motionDelay();
+        if (delay == 0) {
+            if (fMotionTimer)
+                fMotionTimer->stopTimer();
+            applyMotion();
+        }
+        else if (!(fMotionTimer && fMotionTimer->isRunning())) {
+            fMotionTimer->setFixed();
+            fMotionTimer->setTimer(delay, this, true);
+        }
         return ;
     }
     YWindow::handleMotion(motion);
 }
 
+void YFrameWindow::moveSizeStatistics() {
+    if (motionEvents) {
+        tlog("movesize: %lu motion events, %lu updates, %lu unchanged",
+             motionEvents, motionUpdates, motionSkips);
+    }
+}
 
 // vim: set sw=4 ts=4 et:
@@ -319,12 +319,42 @@ static void test_refstr() {
     printf("tested refstring array OK (%s)\n\n", mark.report());
 }
 
+static void test_multi() {
+    const int rows = 5, cols = 3;
+    YMulti<int> m(rows, cols);
+    m.clear();
+
+    watch mark;
+
+    // Append the rows 1..N, each filled with its number.
+    const int N = 23;
+    for (int n = 1; n <= N; ++n) {
+        m.rotate();
+        assert(m.compare(rows - 1, rows - 2) == 0);
+        for (int k = 0; k < cols; ++k)
+            m[rows - 1][k] = n;
+        for (int i = 0; i < rows; ++i) {
+            int expect = max(0, n - (rows - 1) + i);
+            for (int k = 0; k < cols; ++k)
+                assert(m[i][k] == expect);
+            assert(m.sum(i) == cols * expect);
+        }
+    }
+    assert(m.compare(0, rows - 1) < 0);
+    assert(m.compare(rows - 1, 0) > 0);
+    m.clear(rows - 1);
+    assert(m.sum(rows - 1) == 0 && m.sum(rows - 2) == cols * (N - 1));
+
+    printf("tested multi array ring OK (%s)\n\n", mark.report());
+}
+
 int main() {
     test_int();
     test_cptr();
     test_str();
     test_mstr();
     test_refstr();
+    test_multi();
 
     return 0;
 }
@@ -0,0 +1,165 @@
+#include "config.h"
+#include "base.h"
+#include "yxcontext.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <X11/Xutil.h>
+#include <X11/Xresource.h>
+
+char const *ApplicationName("testcontext");
+
+// XContext needs a display; without an X server
+// only YContext is tested.
+static Display* display() {
+    static Display* dpy;
+    static bool opened;
+    if (opened == false) {
+        opened = true;
+        dpy = XOpenDisplay(0);
+        if (dpy == 0)
+            puts("no display: skipping XContext");
+    }
+    return dpy;
+}
+
+class watch {
+    double start;
+public:
+    double time() const {
+        timeval now;
+        gettimeofday(&now, 0);
+        return now.tv_sec + 1e-6 * now.tv_usec;
+    }
+    watch() : start(time()) {}
+    double delta() const { return time() - start; }
+};
+
+// Window identifiers as an X server hands them out:
+// a resource base per client and increasing identifiers per client.
+static Window* windows(int count) {
+    Window* w = new Window[count];
+    const int clients = 1 + count / 100;
+    for (int i = 0; i < count; ++i) {
+        int client = i % clients;
+        int serial = i / clients;
+        w[i] = (Window(client + 32) << 21) | Window(4 * serial + 1);
+    }
+    return w;
+}
+
+static void test_context() {
+    puts("testing YContext against XContext");
+
+    const int count = 20000;
+    Window* w = windows(count);
+    YContext<int> context("test", false);
+    Display* dpy = display();
+    XContext xcontext = XUniqueContext();
+    int* values = new int[count];
+
+    for (int i = 0; i < count; ++i) {
+        values[i] = i;
+        context.save(w[i], &values[i]);
+        if (dpy)
+            XSaveContext(dpy, w[i], xcontext, (XPointer) &values[i]);
+    }
+    for (int i = 1; i < count; i += 3) {
+        bool removed = context.remove(w[i]);
+        assert(removed);
+        removed = context.remove(w[i]);
+        assert(removed == false);
+        if (dpy)
+            XDeleteContext(dpy, w[i], xcontext);
+    }
+    for (int i = 0; i < count; ++i) {
+        int* p = 0;
+        bool found = context.find(w[i], &p);
+        assert(found == (i % 3 != 1));
+        assert(found == false || *p == i);
+        if (dpy) {
+            XPointer q = 0;
+            bool xfound = XFindContext(dpy, w[i], xcontext, &q) == 0;
+            assert(found == xfound);
+            assert(found == false || p == (int *) q);
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        context.remove(w[i]);
+        if (dpy)
+            XDeleteContext(dpy, w[i], xcontext);
+        assert(context.find(w[i]) == 0);
+    }
+    context.statistics();
+
+    delete[] values;
+    delete[] w;
+    puts("ok");
+}
+
+// Compare lookup speed for a realistic mix of hits and misses.
+static void bench_context(int count) {
+    Window* w = windows(count);
+    Window* miss = windows(2 * count);
+    const int lookups = 2000000;
+    int hits = 0;
+
+    YContext<Window> context("bench", false);
+    for (int i = 0; i < count; ++i)
+        context.save(w[i], &w[i]);
+
+    watch ytime;
+    for (int i = 0; i < lookups; ++i) {
+        Window* p = 0;
+        Window key = (i & 3) ? w[(i * 7) % count] : miss[count + i % count];
+        hits += context.find(key, &p);
+    }
+    double ydelta = ytime.delta();
+
+    Display* dpy = display();
+    if (dpy) {
+        XContext xcontext = XUniqueContext();
+        for (int i = 0; i < count; ++i)
+            XSaveContext(dpy, w[i], xcontext, (XPointer) &w[i]);
+
+        watch xtime;
+        for (int i = 0; i < lookups; ++i) {
+            XPointer p = 0;
+            Window key = (i & 3) ? w[(i * 7) % count] : miss[count + i % count];
+            hits -= (XFindContext(dpy, key, xcontext, &p) == 0);
+        }
+        double xdelta = xtime.delta();
+
+        for (int i = 0; i < count; ++i)
+            XDeleteContext(dpy, w[i], xcontext);
+
+        assert(hits == 0);
+        printf("%6d windows: YContext %6.1f ns, XContext %6.1f ns per lookup\n",
+               count, 1e9 * ydelta / lookups, 1e9 * xdelta / lookups);
+    }
+    else {
+        printf("%6d windows: YContext %6.1f ns per lookup\n",
+               count, 1e9 * ydelta / lookups);
+    }
+    context.statistics();
+
+    delete[] miss;
+    delete[] w;
+}
+
+int main(int argc, char **argv) {
+    test_context();
+
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+        const int counts[] = { 1000, 5000, 10000, 20000, 50000, };
+        for (int i = 0; i < int ACOUNT(counts); ++i)
+            bench_context(counts[i]);
+    }
+
+    return 0;
+}
+
+// vim: set sw=4 ts=4 et:
@@ -0,0 +1,184 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "base.h"
+#include "mstring.h"
+#include "yprocfile.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+char const *ApplicationName("testprocfile");
+
+class watch {
+    double start;
+public:
+    double time() const {
+        timeval now;
+        gettimeofday(&now, 0);
+        return now.tv_sec + 1e-6 * now.tv_usec;
+    }
+    watch() : start(time()) {}
+    double delta() const { return time() - start; }
+};
+
+static void write_text(const char* path, const char* text) {
+    FILE* fp = fopen(path, "w");
+    assert(fp);
+    fputs(text, fp);
+    fclose(fp);
+}
+
+static void test_reread(const char* path) {
+    write_text(path, "MemTotal: 100 kB\n");
+    YProcFile file(path);
+    int len = file.read();
+    assert(len == 17);
+    assert(strcmp(file.text(), "MemTotal: 100 kB\n") == 0);
+
+    // The parser may modify the text in place.
+    file.text()[8] = '\0';
+
+    // The same descriptor sees the new contents from the start.
+    unsigned long opens = YProcFile::opens();
+    write_text(path, "MemTotal: 42 kB\n");
+    len = file.read();
+    assert(len == 16);
+    assert(strcmp(file.text(), "MemTotal: 42 kB\n") == 0);
+    assert(YProcFile::opens() == opens);
+}
+
+static void test_grow(const char* path) {
+    char* big = new char[20001];
+    for (int i = 0; i < 20000; ++i)
+        big[i] = (i % 80 == 79) ? '\n' : 'a' + i % 26;
+    big[20000] = '\0';
+    write_text(path, big);
+
+    YProcFile file(path);
+    int len = file.read();
+    assert(len == 20000);
+    assert(strcmp(file.text(), big) == 0);
+    delete[] big;
+}
+
+static void test_prefix(const char* path) {
+    mstring text;
+    for (int i = 0; i < 100; ++i) {
+        char line[80];
+        snprintf(line, sizeof line, "cpu%d 1 2 3 4 5 6 7 8 9 10\n", i);
+        text += line;
+    }
+    for (int i = 0; i < 1000; ++i)
+        text += "intr 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20\n";
+    write_text(path, cstring(text));
+
+    // All cpu rows are read, but not all of the interrupt counts.
+    YProcFile file(path);
+    int len = file.read("cpu");
+    assert(len > 0 && len < int(text.length()));
+    assert(strstr(file.text(), "cpu99 ") != 0);
+    assert(strstr(file.text(), "\nintr ") != 0);
+
+    len = file.read();
+    assert(len == int(text.length()));
+}
+
+static void test_missing(const char* path) {
+    unlink(path);
+    YProcFile file(path);
+    int len = file.read();
+    assert(len == -1);
+    assert(file.isOpen() == false);
+    write_text(path, "1\n");
+    len = file.read();
+    assert(len == 2);
+    assert(file.isOpen());
+
+    YProcFile none;
+    len = none.read();
+    assert(len == -1);
+    none.setPath(path);
+    len = none.read();
+    assert(len == 2);
+    unlink(path);
+}
+
+static unsigned long oldCalls;
+
+// How read_file reads a file: open, read until the end, close.
+static int read_once(const char* path, char* buf, size_t size) {
+    int fd = open(path, O_RDONLY);
+    ++oldCalls;
+    if (fd < 0)
+        return -1;
+    size_t len = 0;
+    for (;;) {
+        ssize_t got = read(fd, buf + len, size - 1 - len);
+        ++oldCalls;
+        if (got <= 0 || (len += got) + 1 >= size)
+            break;
+    }
+    buf[len] = '\0';
+    close(fd);
+    ++oldCalls;
+    return int(len);
+}
+
+// The files which the taskbar monitors read on each tick.
+static void bench(int ticks) {
+    const char* paths[] = { "/proc/meminfo", "/proc/net/dev", "/proc/stat", };
+    const int count = int ACOUNT(paths);
+    static char buf[16384];
+    unsigned long sum = 0;
+
+    oldCalls = 0;
+    watch otime;
+    for (int t = 0; t < ticks; ++t)
+        for (int i = 0; i < count; ++i)
+            sum += read_once(paths[i], buf, sizeof buf) > 0;
+    double odelta = otime.delta();
+
+    YProcFile files[count];
+    for (int i = 0; i < count; ++i)
+        files[i].setPath(paths[i]);
+    unsigned long calls = YProcFile::opens() + YProcFile::reads();
+    watch ntime;
+    for (int t = 0; t < ticks; ++t)
+        for (int i = 0; i < count; ++i)
+            sum += files[i].read() > 0;
+    double ndelta = ntime.delta();
+    calls = YProcFile::opens() + YProcFile::reads() - calls;
+
+    printf("%d ticks of %d files: open/read/close %.1f syscalls, %.1f us; "
+           "pread %.1f syscalls, %.1f us per tick (%lu)\n",
+           ticks, count,
+           double(oldCalls) / ticks, 1e6 * odelta / ticks,
+           double(calls) / ticks, 1e6 * ndelta / ticks, sum);
+}
+
+int main(int argc, char **argv) {
+    bool benchmark = (argc > 1 && strcmp(argv[1], "-b") == 0);
+
+    char path[] = "/tmp/testprocfileXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    puts("testing YProcFile");
+    test_reread(path);
+    test_grow(path);
+    test_prefix(path);
+    test_missing(path);
+    puts("ok");
+
+    if (benchmark)
+        bench(10000);
+    return 0;
+}
+
+// vim: set sw=4 ts=4 et:
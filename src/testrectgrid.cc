@@ -0,0 +1,125 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "base.h"
+#include "yrectgrid.h"
+
+#include <assert.h>
+#include <sys/time.h>
+
+char const *ApplicationName("testrectgrid");
+
+class watch {
+    double start;
+public:
+    double time() const {
+        timeval now;
+        gettimeofday(&now, 0);
+        return now.tv_sec + 1e-6 * now.tv_usec;
+    }
+    watch() : start(time()) {}
+    double delta() const { return time() - start; }
+};
+
+// Window-like rectangles on a screen of 1920x1080.
+static YRect random_rect() {
+    int w = 20 + rand() % 800;
+    int h = 20 + rand() % 600;
+    return YRect(rand() % 1920 - 100, rand() % 1080 - 100, w, h);
+}
+
+static bool touches(const YRect& r, const YRect& a) {
+    return r.x() <= a.x() + int(a.width()) && a.x() <= r.x() + int(r.width())
+        && r.y() <= a.y() + int(a.height()) && a.y() <= r.y() + int(r.height());
+}
+
+static void test_queries(int count) {
+    YRectGrid grid;
+    for (int i = 0; i < count; ++i)
+        grid.add(random_rect());
+    grid.build();
+    assert(grid.count() == count);
+
+    YArray<int> found;
+    for (int q = 0; q < 500; ++q) {
+        YRect area(random_rect());
+        if (q % 10 == 0)
+            area = YRect(area.x(), area.y(), q % 3, q % 2);
+
+        grid.find(area, found);
+        int k = 0;
+        unsigned long sum = 0;
+        for (int i = 0; i < count; ++i) {
+            if (touches(grid[i], area)) {
+                assert(k < found.getCount());
+                assert(found[k] == i);
+                ++k;
+            }
+            sum += grid[i].overlap(area);
+        }
+        assert(k == found.getCount());
+        assert(sum == grid.overlap(area));
+    }
+}
+
+// The coverage of smart placement, as it was done for each candidate.
+static unsigned long linear(const YArray<YRect>& rects, const YRect& area) {
+    unsigned long sum = 0;
+    for (int i = 0; i < rects.getCount(); ++i)
+        sum += rects[i].overlap(area);
+    return sum;
+}
+
+static void bench_coverage(int count) {
+    YArray<YRect> rects;
+    YRectGrid grid;
+    for (int i = 0; i < count; ++i) {
+        YRect r(rand() % 1800, rand() % 1000, 40 + rand() % 200, 30 + rand() % 150);
+        rects.append(r);
+        grid.add(r);
+    }
+    grid.build();
+
+    const int candidates = 4 * count * count / 16;
+    unsigned long lsum = 0, gsum = 0;
+
+    watch ltime;
+    srand(count);
+    for (int i = 0; i < candidates; ++i)
+        lsum += linear(rects, YRect(rand() % 1920, rand() % 1080, 300, 200));
+    double ldelta = ltime.delta();
+
+    watch gtime;
+    srand(count);
+    for (int i = 0; i < candidates; ++i)
+        gsum += grid.overlap(YRect(rand() % 1920, rand() % 1080, 300, 200));
+    double gdelta = gtime.delta();
+
+    assert(lsum == gsum);
+    printf("%4d frames, %7d candidates: linear %8.1f ms, grid %7.1f ms\n",
+           count, candidates, 1e3 * ldelta, 1e3 * gdelta);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    bool bench = (argc > 1 && strcmp(argv[1], "-b") == 0);
+
+    puts("testing YRectGrid against a linear scan");
+    srand(1);
+    test_queries(0);
+    test_queries(1);
+    test_queries(7);
+    test_queries(60);
+    test_queries(600);
+    puts("ok");
+
+    if (bench) {
+        const int counts[] = { 10, 50, 200, 500, 1000, };
+        for (int i = 0; i < int ACOUNT(counts); ++i)
+            bench_coverage(counts[i]);
+    }
+    return 0;
+}
+
+// vim: set sw=4 ts=4 et:
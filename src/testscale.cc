@@ -0,0 +1,298 @@
+#include "config.h"
+#include "base.h"
+#include "yscale.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <sys/time.h>
+
+char const *ApplicationName("testscale");
+
+class watch {
+    double start;
+public:
+    double time() const {
+        timeval now;
+        gettimeofday(&now, 0);
+        return now.tv_sec + 1e-6 * now.tv_usec;
+    }
+    watch() : start(time()) {}
+    double delta() const { return time() - start; }
+};
+
+// A picture with gradients, or with edges, noise and transparency.
+static unsigned char* picture(unsigned w, unsigned h, bool smooth) {
+    unsigned char* p = new unsigned char[4 * w * h];
+    srand(w * 31 + h);
+    for (unsigned y = 0; y < h; ++y) {
+        for (unsigned x = 0; x < w; ++x) {
+            unsigned char* q = p + 4 * (y * w + x);
+            if (smooth) {
+                q[0] = (unsigned char) (255 * x / w);
+                q[1] = (unsigned char) (255 * y / h);
+                q[2] = (unsigned char) (200 * (x + y) / (w + h));
+                q[3] = (unsigned char) (255 - 200 * x / w);
+            } else {
+                int dx = int(x) - int(w / 2), dy = int(y) - int(h / 2);
+                bool inside = unsigned(dx * dx + dy * dy) < w * h / 5;
+                q[0] = (unsigned char) (255 * x / w);
+                q[1] = (unsigned char) (inside ? 200 : rand() & 0xFF);
+                q[2] = (unsigned char) (inside ? 100 : 0);
+                q[3] = (unsigned char) (inside ? 255 : (x + y) & 0x7F);
+            }
+        }
+    }
+    return p;
+}
+
+// The floating point area averaging which YXImage::upscale used.
+static void upscale(const unsigned char* in, unsigned w, unsigned h,
+                    unsigned char* out, unsigned nw, unsigned nh)
+{
+    double* chanls = new double[4 * nw * nh];
+    double* counts = new double[nw * nh];
+    memset(chanls, 0, 4 * nw * nh * sizeof(double));
+    memset(counts, 0, nw * nh * sizeof(double));
+
+    double pppx = (double) w / (double) nw;
+    double pppy = (double) h / (double) nh;
+
+    double ty, by; unsigned l;
+    for (ty = 0.0, by = pppy, l = 0; l < nh; l++, ty += pppy, by += pppy) {
+        for (unsigned j = unsigned(floor(ty)); j < by && j < h; j++) {
+            double yf = 1.0;
+            if (ty < (j + 1) && (j + 1) < by)
+                yf = (j + 1) - ty;
+            else if (ty < j && j < by)
+                yf = by - j;
+            double lx, rx; unsigned k;
+            for (lx = 0.0, rx = pppx, k = 0; k < nw; k++, lx += pppx, rx += pppx) {
+                for (unsigned i = unsigned(floor(lx)); i < rx && i < w; i++) {
+                    double xf = 1.0;
+                    if (lx < (i + 1) && (i + 1) < rx)
+                        xf = (i + 1) - lx;
+                    else if (lx < i && i < rx)
+                        xf = rx - i;
+                    double ff = xf * yf;
+                    unsigned m = l * nw + k;
+                    counts[m] += ff;
+                    for (int c = 0; c < 4; ++c)
+                        chanls[4 * m + c] += in[4 * (j * w + i) + c] * ff;
+                }
+            }
+        }
+    }
+    for (unsigned m = 0; m < nw * nh; ++m)
+        for (int c = 0; c < 4; ++c)
+            out[4 * m + c] = (unsigned char) lround(chanls[4 * m + c] / counts[m]);
+
+    delete[] chanls;
+    delete[] counts;
+}
+
+// The fixed point interpolation which YXImage::downscale used.
+static void downscale(const unsigned char* in, unsigned oldWidth,
+                      unsigned oldHeight, unsigned char* out,
+                      unsigned newWidth, unsigned newHeight)
+{
+    const unsigned shift = 10;
+    unsigned long *sum = new unsigned long[4 * newWidth];
+    unsigned long *div = new unsigned long[newWidth];
+
+    unsigned hacc = 0;
+    unsigned h = 0;
+    unsigned mult = 0;
+    bool repeat = false;
+
+    for (unsigned y = 0; y < oldHeight; y = repeat ? y : 1 + y) {
+        if (hacc < newHeight) {
+            memset(sum, 0, sizeof(*sum) * 4 * newWidth);
+            memset(div, 0, sizeof(*div) * newWidth);
+        }
+
+        if (repeat) {
+            repeat = false;
+            mult = (1 << shift) - mult;
+        }
+        else {
+            hacc += newHeight;
+            if (hacc <= oldHeight) {
+                mult = 1 << shift;
+            }
+            else {
+                mult = ((newHeight / 2) + (1 << shift)
+                     * (newHeight - (hacc - oldHeight)))
+                     / newHeight;
+            }
+        }
+
+        unsigned wacc = 0;
+        unsigned w = 0;
+        const unsigned char* idata = in + 4 * y * oldWidth;
+        for (unsigned x = 0; x < oldWidth; ++x, idata += 4) {
+            wacc += newWidth;
+            if (wacc < oldWidth) {
+                for (int c = 0; c < 4; ++c)
+                    sum[4 * w + c] += (mult << shift) * idata[c];
+                div[w] += mult << shift;
+            }
+            else {
+                unsigned m = (newWidth / 2 + (1 << shift)
+                           * (newWidth - (wacc - oldWidth)))
+                           / newWidth;
+                for (int c = 0; c < 4; ++c)
+                    sum[4 * w + c] += m * mult * idata[c];
+                div[w] += m * mult;
+                ++w;
+                wacc -= oldWidth;
+                if (wacc > 0) {
+                    m = (1 << shift) - m;
+                    for (int c = 0; c < 4; ++c)
+                        sum[4 * w + c] += m * mult * idata[c];
+                    div[w] += m * mult;
+                }
+            }
+        }
+
+        if (hacc >= oldHeight) {
+            hacc -= oldHeight;
+            if (hacc > 0) {
+                repeat = true;
+            }
+            unsigned char* odata = out + 4 * h * newWidth;
+            for (unsigned k = 0; k < newWidth; ++k) {
+                unsigned long d = non_zero(div[k]);
+                for (int c = 0; c < 4; ++c)
+                    *odata++ = (unsigned char) (sum[4 * k + c] / d);
+            }
+            ++h;
+        }
+    }
+
+    delete[] sum;
+    delete[] div;
+}
+
+// Exact area averaging with rational weights.
+static void average(const unsigned char* in, unsigned w, unsigned h,
+                    unsigned char* out, unsigned nw, unsigned nh)
+{
+    for (unsigned l = 0; l < nh; ++l) {
+        for (unsigned k = 0; k < nw; ++k) {
+            double sum[4] = { 0, 0, 0, 0 };
+            for (unsigned j = l * h / nh; j * nh < (l + 1) * h; ++j) {
+                double yf = double(min((j + 1) * nh, (l + 1) * h)
+                                   - max(j * nh, l * h));
+                for (unsigned i = k * w / nw; i * nw < (k + 1) * w; ++i) {
+                    double xf = double(min((i + 1) * nw, (k + 1) * w)
+                                       - max(i * nw, k * w));
+                    for (int c = 0; c < 4; ++c)
+                        sum[c] += xf * yf * in[4 * (j * w + i) + c];
+                }
+            }
+            for (int c = 0; c < 4; ++c)
+                out[4 * (l * nw + k) + c] =
+                    (unsigned char) lround(sum[c] / (double(w) * h));
+        }
+    }
+}
+
+static int difference(const unsigned char* a, const unsigned char* b, unsigned n) {
+    int most = 0;
+    for (unsigned i = 0; i < n; ++i)
+        most = max(most, abs(int(a[i]) - int(b[i])));
+    return most;
+}
+
+// The scaler which YXImage used before for this case.
+// The former upscale is only accurate when no axis shrinks.
+static void former(const unsigned char* in, unsigned w, unsigned h,
+                   unsigned char* out, unsigned nw, unsigned nh)
+{
+    if (nw <= w && nh <= h)
+        downscale(in, w, h, out, nw, nh);
+    else
+        upscale(in, w, h, out, nw, nh);
+}
+
+static void test_scale(unsigned w, unsigned h, unsigned nw, unsigned nh,
+                       int repeat)
+{
+    unsigned char* want = new unsigned char[4 * nw * nh];
+    unsigned char* have = new unsigned char[4 * nw * nh];
+
+    // On smooth pictures the former scalers agree with area averaging.
+    int diff = 0;
+    unsigned char* in = picture(w, h, true);
+    if ((nw <= w && nh <= h) || (nw >= w && nh >= h)) {
+        former(in, w, h, want, nw, nh);
+        YScaler(w, h, nw, nh).scale(in, 4 * w, have, 4 * nw);
+        diff = difference(want, have, 4 * nw * nh);
+    }
+    delete[] in;
+
+    // Sharp edges must give the exact area average, up to the rounding
+    // of the fixed-point weights, which adds up for extreme reductions.
+    in = picture(w, h, false);
+    average(in, w, h, want, nw, nh);
+    YScaler(w, h, nw, nh).scale(in, 4 * w, have, 4 * nw);
+    int exact = difference(want, have, 4 * nw * nh);
+
+    if (repeat > 1 || diff > 3 || exact > 2) {
+        watch ftime;
+        for (int i = 0; i < repeat; ++i)
+            former(in, w, h, want, nw, nh);
+        double fdelta = ftime.delta();
+
+        watch stime;
+        for (int i = 0; i < repeat; ++i)
+            YScaler(w, h, nw, nh).scale(in, 4 * w, have, 4 * nw);
+        double sdelta = stime.delta();
+
+        printf("%4ux%-4u -> %4ux%-4u: former %8.1f us, YScaler %7.1f us,"
+               " diff %d, exact %d\n", w, h, nw, nh,
+               1e6 * fdelta / repeat, 1e6 * sdelta / repeat, diff, exact);
+        fflush(stdout);
+    }
+    assert(diff <= 3);
+    assert(exact <= 2);
+
+    delete[] in;
+    delete[] want;
+    delete[] have;
+}
+
+int main(int argc, char **argv) {
+    bool bench = (argc > 1 && strcmp(argv[1], "-b") == 0);
+    const unsigned sizes[] = { 16, 32, 48, 256, };
+    const int count = int ACOUNT(sizes);
+
+    puts("testing YScaler against the former scalers");
+    for (int i = 0; i < count; ++i)
+        for (int k = 0; k < count; ++k)
+            if (i != k)
+                test_scale(sizes[i], sizes[i], sizes[k], sizes[k], 1);
+    test_scale(7, 13, 22, 5, 1);
+    test_scale(100, 3, 9, 40, 1);
+    test_scale(1, 1, 64, 64, 1);
+    test_scale(640, 480, 1, 1, 1);
+    puts("ok");
+
+    if (bench) {
+        for (int i = 0; i < count; ++i) {
+            for (int k = 0; k < count; ++k) {
+                if (i != k) {
+                    unsigned pixels = max(sizes[i], sizes[k]);
+                    int repeat = max(4, int(4000000 / (pixels * pixels)));
+                    test_scale(sizes[i], sizes[i], sizes[k], sizes[k], repeat);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// vim: set sw=4 ts=4 et:
@@ -28,6 +28,8 @@
 #include "appnames.h"
 #include "ypaths.h"
 #include "yxcontext.h"
+#include "wmprop.h"
+#include "yprocfile.h"
 #ifdef CONFIG_XFREETYPE
 #include <ft2build.h>
 #include <X11/Xft/Xft.h>
@@ -1100,6 +1102,7 @@ YWMApp::YWMApp(int *argc, char ***argv, const char *displayName,
 {
     wmapp = this;
 
+    YConfig::openCache(getPrivConfDir() + "/prefscache");
     WMConfig::loadConfiguration(this, configFile);
     if (themeName != 0) {
         MSG(("themeName=%s", themeName));
@@ -1121,6 +1124,7 @@ YWMApp::YWMApp(int *argc, char ***argv, const char *displayName,
     WMConfig::loadConfiguration(this, "prefoverride");
     if (focusMode != FocusCustom)
         initFocusMode();
+    YConfig::closeCache();
 
     DEPRECATE(warpPointer == true);
     DEPRECATE(focusRootWindow == true);
@@ -1139,6 +1143,7 @@ YWMApp::YWMApp(int *argc, char ***argv, const char *displayName,
     catchSignal(SIGQUIT);
     catchSignal(SIGHUP);
     catchSignal(SIGCHLD);
+    catchSignal(SIGUSR1);
     catchSignal(SIGUSR2);
     catchSignal(SIGPIPE);
 
@@ -1309,6 +1314,10 @@ void YWMApp::handleSignal(int sig) {
         actionPerformed(actionRestart, 0);
         break;
 
+    case SIGUSR1:
+        logStatistics();
+        break;
+
     case SIGUSR2:
         tlog("logEvents %s", boolstr(toggleLogEvents()));
         break;
@@ -1324,10 +1333,31 @@ void YWMApp::handleSignal(int sig) {
     }
 }
 
+void YWMApp::logStatistics() {
+    tlog("wakeups per minute: %d", wakeupsPerMinute());
+    windowContext.statistics();
+    frameContext.statistics();
+    clientContext.statistics();
+    YClientProperties::statistics();
+    manager->clientListStatistics();
+    manager->restackStatistics();
+    YFrameWindow::moveSizeStatistics();
+    YProcFile::statistics();
+    YIcon::statistics();
+    YFont::statistics();
+    YWindow::statistics();
+    YConfig::statistics();
+}
+
 bool YWMApp::handleIdle() {
     static int qbits;
     bool busy = YSMApplication::handleIdle();
 
+    if (manager) {
+        manager->flushRestack();
+        manager->flushClientList();
+    }
+
     if ((QLength(display()) >> qbits) > 0) {
         ++qbits;
     }
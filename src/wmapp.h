@@ -122,6 +122,7 @@ private:
     lazy<YWindow> splashWindow;
 
     void createTaskBar();
+    void logStatistics();
     YWindow* splash(const char* splashFile);
     virtual bool handleTimer(YTimer *timer);
     virtual int handleError(XErrorEvent *xev);
@@ -15,6 +15,7 @@
 #include "sysdep.h"
 #include "yxcontext.h"
 #include "workspaces.h"
+#include "wmprop.h"
 
 bool operator==(const XSizeHints& a, const XSizeHints& b) {
     return (a.flags & PAllHints) == (b.flags & PAllHints) &&
@@ -414,7 +415,7 @@ bool YFrameClient::getNetWMPid(long *pid) {
     unsigned long nitems = 0;
     unsigned long after = 0;
     unsigned char* prop = 0;
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                            _XA_NET_WM_PID, 0, 1, False, XA_CARDINAL,
                            &type, &format, &nitems, &after,
                            &prop) == Success && prop)
@@ -479,27 +480,27 @@ void YFrameClient::setFrameState(FrameState state) {
     if (state == WithdrawnState) {
         if (manager->wmState() != YWindowManager::wmSHUTDOWN) {
             MSG(("deleting window properties id=%lX", handle()));
-            XDeleteProperty(xapp->display(), handle(), _XA_NET_FRAME_EXTENTS);
-            XDeleteProperty(xapp->display(), handle(), _XA_NET_WM_VISIBLE_NAME);
-            XDeleteProperty(xapp->display(), handle(), _XA_NET_WM_VISIBLE_ICON_NAME);
-            XDeleteProperty(xapp->display(), handle(), _XA_NET_WM_DESKTOP);
-            XDeleteProperty(xapp->display(), handle(), _XA_NET_WM_STATE);
-            XDeleteProperty(xapp->display(), handle(), _XA_NET_WM_ALLOWED_ACTIONS);
-            XDeleteProperty(xapp->display(), handle(), _XA_WIN_WORKSPACE);
-            XDeleteProperty(xapp->display(), handle(), _XA_WIN_LAYER);
-            XDeleteProperty(xapp->display(), handle(), _XA_WIN_TRAY);
-            XDeleteProperty(xapp->display(), handle(), _XA_WIN_STATE);
-            XDeleteProperty(xapp->display(), handle(), _XA_WM_STATE);
+            deleteWindowProperty(xapp->display(), handle(), _XA_NET_FRAME_EXTENTS);
+            deleteWindowProperty(xapp->display(), handle(), _XA_NET_WM_VISIBLE_NAME);
+            deleteWindowProperty(xapp->display(), handle(), _XA_NET_WM_VISIBLE_ICON_NAME);
+            deleteWindowProperty(xapp->display(), handle(), _XA_NET_WM_DESKTOP);
+            deleteWindowProperty(xapp->display(), handle(), _XA_NET_WM_STATE);
+            deleteWindowProperty(xapp->display(), handle(), _XA_NET_WM_ALLOWED_ACTIONS);
+            deleteWindowProperty(xapp->display(), handle(), _XA_WIN_WORKSPACE);
+            deleteWindowProperty(xapp->display(), handle(), _XA_WIN_LAYER);
+            deleteWindowProperty(xapp->display(), handle(), _XA_WIN_TRAY);
+            deleteWindowProperty(xapp->display(), handle(), _XA_WIN_STATE);
+            deleteWindowProperty(xapp->display(), handle(), _XA_WM_STATE);
             fSavedFrameState = InvalidFrameState;
             fSavedWinState[0] = fSavedWinState[1] = 0;
         }
     }
     else if (state != fSavedFrameState) {
         long arg[2] = { state, None };
-        XChangeProperty(xapp->display(), handle(),
-                        _XA_WM_STATE, _XA_WM_STATE,
-                        32, PropModeReplace,
-                        (unsigned char *)arg, 2);
+        changeWindowProperty(xapp->display(), handle(),
+                             _XA_WM_STATE, _XA_WM_STATE,
+                             32, PropModeReplace,
+                             (unsigned char *)arg, 2);
         fSavedFrameState = state;
     }
 }
@@ -516,7 +517,7 @@ FrameState YFrameClient::getFrameState() {
     unsigned long nitems, lbytes;
     unsigned char *propdata(0);
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                            _XA_WM_STATE, 0, 2, False, _XA_WM_STATE,
                            &type, &format, &nitems, &lbytes,
                            &propdata) == Success && propdata)
@@ -757,13 +758,13 @@ void YFrameClient::setWindowTitle(const char *title) {
         fWindowTitle = mstring(title);
         if (title != 0) {
             cstring cs(fWindowTitle);
-            XChangeProperty(xapp->display(), handle(),
+            changeWindowProperty(xapp->display(), handle(),
                     _XA_NET_WM_VISIBLE_NAME, _XA_UTF8_STRING,
                     8, PropModeReplace,
                     (const unsigned char *)cs.c_str(),
                     cs.c_str_len());
         } else {
-            XDeleteProperty(xapp->display(), handle(),
+            deleteWindowProperty(xapp->display(), handle(),
                     _XA_NET_WM_VISIBLE_NAME);
         }
         if (getFrame()) getFrame()->updateTitle();
@@ -775,13 +776,13 @@ void YFrameClient::setIconTitle(const char *title) {
         fIconTitle = mstring(title);
         if (title != 0) {
             cstring cs(fIconTitle);
-            XChangeProperty(xapp->display(), handle(),
+            changeWindowProperty(xapp->display(), handle(),
                     _XA_NET_WM_VISIBLE_ICON_NAME, _XA_UTF8_STRING,
                     8, PropModeReplace,
                     (const unsigned char *)cs.c_str(),
                     cs.c_str_len());
         } else {
-            XDeleteProperty(xapp->display(), handle(),
+            deleteWindowProperty(xapp->display(), handle(),
                     _XA_NET_WM_VISIBLE_ICON_NAME);
         }
         if (getFrame()) getFrame()->updateIconTitle();
@@ -886,7 +887,7 @@ long getMask(Atom a) {
 
 void YFrameClient::setNetWMFullscreenMonitors(int top, int bottom, int left, int right) {
     long data[4] = { top, bottom, left, right };
-    XChangeProperty (xapp->display(), handle(),
+    changeWindowProperty(xapp->display(), handle(),
                         _XA_NET_WM_FULLSCREEN_MONITORS, XA_CARDINAL,
                         32, PropModeReplace,
                         (unsigned char *) data, 4);
@@ -894,14 +895,14 @@ void YFrameClient::setNetWMFullscreenMonitors(int top, int bottom, int left, int
 
 void YFrameClient::setNetFrameExtents(int left, int right, int top, int bottom) {
     long data[4] = { left, right, top, bottom };
-    XChangeProperty(xapp->display(), handle(),
+    changeWindowProperty(xapp->display(), handle(),
                         _XA_NET_FRAME_EXTENTS, XA_CARDINAL,
                         32, PropModeReplace,
                         (unsigned  char *) data, 4);
 }
 
 void YFrameClient::setNetWMAllowedActions(Atom *actions, int count) {
-    XChangeProperty (xapp->display(), handle(),
+    changeWindowProperty(xapp->display(), handle(),
                         _XA_NET_WM_ALLOWED_ACTIONS, XA_ATOM,
                         32, PropModeReplace,
                         (unsigned char *) actions, count);
@@ -1121,7 +1122,7 @@ void YFrameClient::getMwmHints() {
         unsigned char *xptr;
     } mwmHints = { 0 };
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                            _XATOM_MWM_HINTS, 0L, 20L, False, _XATOM_MWM_HINTS,
                            &retType, &retFormat, &retCount,
                            &remain, &(mwmHints.xptr)) == Success && mwmHints.ptr)
@@ -1136,10 +1137,10 @@ void YFrameClient::getMwmHints() {
 }
 
 void YFrameClient::setMwmHints(const MwmHints &mwm) {
-    XChangeProperty(xapp->display(), handle(),
-                    _XATOM_MWM_HINTS, _XATOM_MWM_HINTS,
-                    32, PropModeReplace,
-                    (const unsigned char *)&mwm, PROP_MWM_HINTS_ELEMENTS);
+    changeWindowProperty(xapp->display(), handle(),
+                         _XATOM_MWM_HINTS, _XATOM_MWM_HINTS,
+                         32, PropModeReplace,
+                         (const unsigned char *)&mwm, PROP_MWM_HINTS_ELEMENTS);
     if (fMwmHints == 0)
         fMwmHints = (MwmHints *)malloc(sizeof(MwmHints));
     if (fMwmHints)
@@ -1236,7 +1237,7 @@ bool YFrameClient::getKwmIcon(int *count, Pixmap **pixmap) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                            _XA_KWM_WIN_ICON, 0, 2, False, _XA_KWM_WIN_ICON,
                            &r_type, &r_format, &nitems, &bytes_remain,
                            &prop) == Success && prop)
@@ -1274,7 +1275,7 @@ bool YFrameClient::getWinIcons(Atom *type, int *count, long **elem) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                            _XA_WIN_ICONS, 0, 4096, False, AnyPropertyType,
                            &r_type, &r_format, &nitems, &bytes_remain,
                            &prop) == Success && prop)
@@ -1310,7 +1311,7 @@ static void *GetFullWindowProperty(Display *display, Window handle, Atom propAto
         unsigned long bytes_remain;
         unsigned char *prop(0);
 
-        while (XGetWindowProperty(display, handle,
+        while (fetchWindowProperty(display, handle,
                                propAtom, (itemCount * itemSize1) / 32, 1024*32, False, AnyPropertyType,
                                &r_type, &r_format, &nitems, &bytes_remain,
                                &prop) == Success && prop)
@@ -1356,7 +1357,7 @@ bool YFrameClient::getNetWMIcon(int *count, long **elem) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                            _XA_NET_WM_ICON, 0, 1024*256, False, AnyPropertyType,
                            &r_type, &r_format, &nitems, &bytes_remain,
                            &prop) == Success && prop)
@@ -1377,19 +1378,19 @@ bool YFrameClient::getNetWMIcon(int *count, long **elem) {
 }
 
 void YFrameClient::setWinWorkspaceHint(long wk) {
-    XChangeProperty(xapp->display(),
-                    handle(),
-                    _XA_WIN_WORKSPACE,
-                    XA_CARDINAL,
-                    32, PropModeReplace,
-                    (unsigned char *)&wk, 1);
+    changeWindowProperty(xapp->display(),
+                         handle(),
+                         _XA_WIN_WORKSPACE,
+                         XA_CARDINAL,
+                         32, PropModeReplace,
+                         (unsigned char *)&wk, 1);
 
-    XChangeProperty(xapp->display(),
-                    handle(),
-                    _XA_NET_WM_DESKTOP,
-                    XA_CARDINAL,
-                    32, PropModeReplace,
-                    (unsigned char *)&wk, 1);
+    changeWindowProperty(xapp->display(),
+                         handle(),
+                         _XA_NET_WM_DESKTOP,
+                         XA_CARDINAL,
+                         32, PropModeReplace,
+                         (unsigned char *)&wk, 1);
 }
 
 bool YFrameClient::getWinWorkspaceHint(long *workspace) {
@@ -1404,7 +1405,7 @@ bool YFrameClient::getWinWorkspaceHint(long *workspace) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WIN_WORKSPACE,
                            0, 1, False, XA_CARDINAL,
@@ -1425,12 +1426,12 @@ bool YFrameClient::getWinWorkspaceHint(long *workspace) {
 }
 
 void YFrameClient::setWinLayerHint(long layer) {
-    XChangeProperty(xapp->display(),
-                    handle(),
-                    _XA_WIN_LAYER,
-                    XA_CARDINAL,
-                    32, PropModeReplace,
-                    (unsigned char *)&layer, 1);
+    changeWindowProperty(xapp->display(),
+                         handle(),
+                         _XA_WIN_LAYER,
+                         XA_CARDINAL,
+                         32, PropModeReplace,
+                         (unsigned char *)&layer, 1);
 }
 
 bool YFrameClient::getWinLayerHint(long *layer) {
@@ -1440,7 +1441,7 @@ bool YFrameClient::getWinLayerHint(long *layer) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WIN_LAYER,
                            0, 1, False, XA_CARDINAL,
@@ -1467,7 +1468,7 @@ bool YFrameClient::getWinTrayHint(long *tray_opt) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WIN_TRAY,
                            0, 1, False, XA_CARDINAL,
@@ -1488,12 +1489,12 @@ bool YFrameClient::getWinTrayHint(long *tray_opt) {
 }
 
 void YFrameClient::setWinTrayHint(long tray_opt) {
-    XChangeProperty(xapp->display(),
-                    handle(),
-                    _XA_WIN_TRAY,
-                    XA_CARDINAL,
-                    32, PropModeReplace,
-                    (unsigned char *)&tray_opt, 1);
+    changeWindowProperty(xapp->display(),
+                         handle(),
+                         _XA_WIN_TRAY,
+                         XA_CARDINAL,
+                         32, PropModeReplace,
+                         (unsigned char *)&tray_opt, 1);
 }
 
 bool YFrameClient::getWinStateHint(long *mask, long *state) {
@@ -1503,7 +1504,7 @@ bool YFrameClient::getWinStateHint(long *mask, long *state) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WIN_STATE,
                            0, 2, False, XA_CARDINAL,
@@ -1541,12 +1542,12 @@ void YFrameClient::setWinStateHint(long mask, long state) {
     if (hasbit(mask, state ^ fSavedWinState[0]) || mask != fSavedWinState[1]) {
         long prop[2] = { state & mask, mask };
 
-        XChangeProperty(xapp->display(),
-                        handle(),
-                        _XA_WIN_STATE,
-                        XA_CARDINAL,
-                        32, PropModeReplace,
-                        (unsigned char *) prop, 2);
+        changeWindowProperty(xapp->display(),
+                             handle(),
+                             _XA_WIN_STATE,
+                             XA_CARDINAL,
+                             32, PropModeReplace,
+                             (unsigned char *) prop, 2);
 
         fSavedWinState[0] = state;
         fSavedWinState[1] = mask;
@@ -1589,10 +1590,10 @@ void YFrameClient::setWinStateHint(long mask, long state) {
     if (state & WinStateUrgent)
         a[i++] = _XA_NET_WM_STATE_DEMANDS_ATTENTION;
 
-    XChangeProperty(xapp->display(), handle(),
-                    _XA_NET_WM_STATE, XA_ATOM,
-                    32, PropModeReplace,
-                    (unsigned char *)a, i);
+    changeWindowProperty(xapp->display(), handle(),
+                         _XA_NET_WM_STATE, XA_ATOM,
+                         32, PropModeReplace,
+                         (unsigned char *)a, i);
 
     fSavedWinState[0] = state;
     fSavedWinState[1] = mask;
@@ -1607,7 +1608,7 @@ bool YFrameClient::getNetWMStateHint(long *mask, long *state) {
 
     *mask = 0;
     *state = 0;
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_NET_WM_STATE,
                            0, 64, False, XA_ATOM,
@@ -1696,7 +1697,7 @@ bool YFrameClient::getWinHintsHint(long *state) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WIN_HINTS,
                            0, 1, False, XA_CARDINAL,
@@ -1723,12 +1724,12 @@ void YFrameClient::setWinHintsHint(long hints) {
     s[0] = hints;
     fWinHints = hints;
 
-    XChangeProperty(xapp->display(),
-                    handle(),
-                    _XA_WIN_HINTS,
-                    XA_CARDINAL,
-                    32, PropModeReplace,
-                    (unsigned char *)&s, 1);
+    changeWindowProperty(xapp->display(),
+                         handle(),
+                         _XA_WIN_HINTS,
+                         XA_CARDINAL,
+                         32, PropModeReplace,
+                         (unsigned char *)&s, 1);
 }
 
 void YFrameClient::getClientLeader() {
@@ -1739,7 +1740,7 @@ void YFrameClient::getClientLeader() {
     unsigned char *prop(0);
 
     fClientLeader = None;
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WM_CLIENT_LEADER,
                            0, 1, False, XA_WINDOW,
@@ -1768,7 +1769,7 @@ void YFrameClient::getWindowRole() {
         unsigned char *xptr;
     } role = { 0 };
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WINDOW_ROLE,
                            0, 256, False, XA_STRING,
@@ -1800,7 +1801,7 @@ void YFrameClient::getWMWindowRole() {
         unsigned char *xptr;
     } role = { 0 };
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_WM_WINDOW_ROLE,
                            0, 256, False, XA_STRING,
@@ -1835,7 +1836,7 @@ ustring YFrameClient::getClientId(Window leader) { /// !!! fix
     unsigned long count;
     unsigned long bytes_remain;
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            leader,
                            _XA_SM_CLIENT_ID,
                            0, 256, False, XA_STRING,
@@ -1871,7 +1872,7 @@ bool YFrameClient::getNetWMStrut(int *left, int *right, int *top, int *bottom) {
     unsigned long bytes_remain;
     xsmart<unsigned char> prop;
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_NET_WM_STRUT,
                            0, 4, False, XA_CARDINAL,
@@ -1907,7 +1908,7 @@ bool YFrameClient::getNetWMStrutPartial(int *left, int *right, int *top, int *bo
     unsigned long bytes_remain;
     xsmart<unsigned char> prop;
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_NET_WM_STRUT_PARTIAL,
                            0, 12, False, XA_CARDINAL,
@@ -1957,7 +1958,7 @@ bool YFrameClient::getNetWMUserTime(Window window, unsigned long &time) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(), window,
+    if (fetchWindowProperty(xapp->display(), window,
                 _XA_NET_WM_USER_TIME, 0, 1, False, XA_CARDINAL,
                 &r_type, &r_format, &count, &bytes_remain, &prop) == Success && prop)
     {
@@ -1988,7 +1989,7 @@ bool YFrameClient::getNetWMUserTimeWindow(Window &window) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                 _XA_NET_WM_USER_TIME_WINDOW, 0, 1, False, XA_WINDOW,
                 &r_type, &r_format, &count, &bytes_remain, &prop) == Success && prop)
     {
@@ -2016,7 +2017,7 @@ bool YFrameClient::getNetWMWindowOpacity(long &opacity) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                 _XA_NET_WM_WINDOW_OPACITY, 0, 1, False, XA_CARDINAL,
                 &r_type, &r_format, &count, &bytes_remain, &prop) == Success && prop)
     {
@@ -2046,7 +2047,7 @@ bool YFrameClient::getNetWMWindowType(Atom *window_type) { // !!! for now, map t
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(), handle(),
+    if (fetchWindowProperty(xapp->display(), handle(),
                            _XA_NET_WM_WINDOW_TYPE, 0, 64, False, AnyPropertyType,
                            &r_type, &r_format, &nitems, &bytes_remain,
                            &prop) == Success && prop)
@@ -2131,7 +2132,7 @@ bool YFrameClient::getNetWMDesktopHint(long *workspace) {
     unsigned long bytes_remain;
     unsigned char *prop(0);
 
-    if (XGetWindowProperty(xapp->display(),
+    if (fetchWindowProperty(xapp->display(),
                            handle(),
                            _XA_NET_WM_DESKTOP,
                            0, 1, False, XA_CARDINAL,
@@ -2157,7 +2158,7 @@ void YFrameClient::getPropertiesList() {
 
     memset(&prop, 0, sizeof(prop));
 
-    p = XListProperties(xapp->display(), handle(), &count);
+    p = fetchPropertyList(xapp->display(), handle(), &count);
 
 //    #define HAS(x) do { puts(#x); x = true; } while (0)
 #define HAS(x) do { x = true; } while (0)
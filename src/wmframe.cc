@@ -141,6 +141,8 @@ YFrameWindow::~YFrameWindow() {
         fDelayFocusTimer->disableTimerListener(this);
     if (fAutoRaiseTimer)
         fAutoRaiseTimer->disableTimerListener(this);
+    if (fMotionTimer)
+        fMotionTimer->disableTimerListener(this);
     if (movingWindow || sizingWindow)
         endMoveSize();
     if (fPopupActive)
@@ -710,6 +712,7 @@ void YFrameWindow::configureClient(const XConfigureRequestEvent &configureReques
                              handle(),
                              configureRequest.value_mask & (CWSibling | CWStackMode),
                              &xwc);
+            manager->invalidateStacking();
         } else if (xwc.sibling == None /*&& manager->top(getLayer()) != 0*/) {
             switch (xwc.stack_mode) {
             case Above:
@@ -904,6 +907,8 @@ bool YFrameWindow::handleTimer(YTimer *t) {
     }
     if (t == fDelayFocusTimer)
         focus(false);
+    if (t == fMotionTimer)
+        applyMotion();
     return false;
 }
 
@@ -911,6 +916,7 @@ void YFrameWindow::raise() {
     if (this != manager->top(getActiveLayer())) {
         YWindow::raise();
         setAbove(manager->top(getActiveLayer()));
+        manager->invalidateStacking();
     }
 }
 
@@ -918,6 +924,7 @@ void YFrameWindow::lower() {
     if (this != manager->bottom(getActiveLayer())) {
         YWindow::lower();
         setAbove(0);
+        manager->invalidateStacking();
     }
 }
 
@@ -131,6 +131,9 @@ public:
     void handleMoveMouse(const XMotionEvent &motion, int &newX, int &newY);
     void handleResizeMouse(const XMotionEvent &motion,
                            int &newX, int &newY, int &newWidth, int &newHeight);
+    void applyMotion();
+    static long motionDelay();
+    static void moveSizeStatistics();
 
     void outlineMove();
     void outlineResize();
@@ -483,6 +486,7 @@ private:
 
     static lazy<YTimer> fAutoRaiseTimer;
     static lazy<YTimer> fDelayFocusTimer;
+    static lazy<YTimer> fMotionTimer;
 
     int fWinWorkspace;
     long fWinRequestedLayer;
@@ -23,6 +23,8 @@
 #include "yprefs.h"
 #include "yxcontext.h"
 #include "workspaces.h"
+#include "wmprop.h"
+#include "yrectgrid.h"
 #include "ystring.h"
 
 YContext<YFrameClient> clientContext("clientContext", false);
@@ -78,6 +80,18 @@ YWindowManager::YWindowManager(
     fFullscreenEnabled = true;
     fCreatedUpdated = true;
     fLayeredUpdated = true;
+    fClientListBytes = 0;
+    fClientListWrites = 0;
+    fClientListAppends = 0;
+    fClientListSkips = 0;
+    fSnapGrid = 0;
+    fSnapFrame = 0;
+    fRestackPending = false;
+    fRestackRequests = 0;
+    fRestackFlushes = 0;
+    fRestackFull = 0;
+    fRestackMoves = 0;
+    fRestackListed = 0;
 
     setWmState(wmSTARTUP);
     setStyle(wsManager);
@@ -123,6 +137,7 @@ YWindowManager::~YWindowManager() {
     }
     delete fTopWin;
     delete rootProxy;
+    delete fSnapGrid;
 }
 
 void YWindowManager::setWmState(WMState newWmState) {
@@ -1080,6 +1095,8 @@ void YWindowManager::unmanageClients() {
         }
     }
 
+    flushRestack();
+    flushClientList();
     XSetInputFocus(xapp->display(), PointerRoot, RevertToNone, CurrentTime);
     ungrabServer();
     XSync(xapp->display(), True);
@@ -1108,18 +1125,9 @@ static int addco(int *v, int &n, int c) {
     return 1;
 }
 
-int YWindowManager::calcCoverage(bool down, YFrameWindow *frame1, int x, int y, int w, int h) {
-    int cover = 0;
-    int factor = down ? 2 : 1; // try harder not to cover top windows
-    const YRect rect(x, y, w, h);
-
-    YFrameWindow *frame = 0;
-
-    if (down) {
-        frame = top(frame1->getActiveLayer());
-    } else {
-        frame = frame1;
-    }
+// The frames which count in calcCoverage, in the order of the layers.
+static void coverFrames(bool down, YFrameWindow *frame1, YRectGrid& covers) {
+    YFrameWindow *frame = down ? manager->top(frame1->getActiveLayer()) : frame1;
     for (YFrameWindow * f = frame; f ; f = (down ? f->next() : f->prev())) {
         if (f == frame1 || f->isMinimized() || f->isHidden() || !f->isManaged())
             continue;
@@ -1127,33 +1135,39 @@ int YWindowManager::calcCoverage(bool down, YFrameWindow *frame1, int x, int y,
         if (!f->isAllWorkspaces() && f->getWorkspace() != frame1->getWorkspace())
             continue;
 
-        cover += rect.overlap(f->geometry()) * factor;
-
-        if (factor > 1)
-            factor /= 2;
+        covers.add(f->geometry());
     }
+    covers.build();
+}
+
+int YWindowManager::calcCoverage(bool down, const YRectGrid& covers, int x, int y, int w, int h) {
+    const YRect rect(x, y, w, h);
+    int cover = int(covers.overlap(rect));
+
+    // try harder not to cover top windows
+    if (down && covers.count() > 0)
+        cover += int(covers[0].overlap(rect));
+
     //msg("coverage %d %d %d %d = %d", x, y, w, h, cover);
     return cover;
 }
 
-void YWindowManager::tryCover(bool down, YFrameWindow *frame, int x, int y, int w, int h,
-                              int &px, int &py, int &cover, int xiscreen)
+void YWindowManager::tryCover(bool down, const YRectGrid& covers,
+                              const YRect& area, int x, int y, int w, int h,
+                              int &px, int &py, int &cover)
 {
     int ncover;
 
-    int mx, my, Mx, My;
-    manager->getWorkArea(frame, &mx, &my, &Mx, &My, xiscreen);
-
-    if (x < mx)
+    if (x < area.x())
         return ;
-    if (y < my)
+    if (y < area.y())
         return ;
-    if (x + w > Mx)
+    if (x + w > area.x() + int(area.width()))
         return ;
-    if (y + h > My)
+    if (y + h > area.y() + int(area.height()))
         return ;
 
-    ncover = calcCoverage(down, frame, x, y, w, h);
+    ncover = calcCoverage(down, covers, x, y, w, h);
     if (ncover < cover) {
         //msg("min: %d %d %d", ncover, x, y);
         px = x;
@@ -1165,6 +1179,7 @@ void YWindowManager::tryCover(bool down, YFrameWindow *frame, int x, int y, int
 bool YWindowManager::getSmartPlace(bool down, YFrameWindow *frame1, int &x, int &y, int w, int h, int xiscreen) {
     int mx, my, Mx, My;
     manager->getWorkArea(frame1, &mx, &my, &Mx, &My, xiscreen);
+    const YRect area(mx, my, unsigned(max(0, Mx - mx)), unsigned(max(0, My - my)));
 
     x = mx;
     y = my;
@@ -1211,17 +1226,20 @@ bool YWindowManager::getSmartPlace(bool down, YFrameWindow *frame1, int &x, int
     assert(xcount <= n);
     assert(ycount <= n);
 
+    YRectGrid covers;
+    coverFrames(down, frame1, covers);
+
     int xn = 0, yn = 0;
     px = x; py = y;
-    cover = calcCoverage(down, frame1, x, y, w, h);
+    cover = calcCoverage(down, covers, x, y, w, h);
     while (1) {
         x = xcoord[xn];
         y = ycoord[yn];
 
-        tryCover(down, frame1, x - w, y - h, w, h, px, py, cover, xiscreen);
-        tryCover(down, frame1, x - w, y    , w, h, px, py, cover, xiscreen);
-        tryCover(down, frame1, x    , y - h, w, h, px, py, cover, xiscreen);
-        tryCover(down, frame1, x    , y    , w, h, px, py, cover, xiscreen);
+        tryCover(down, covers, area, x - w, y - h, w, h, px, py, cover);
+        tryCover(down, covers, area, x - w, y    , w, h, px, py, cover);
+        tryCover(down, covers, area, x    , y - h, w, h, px, py, cover);
+        tryCover(down, covers, area, x    , y    , w, h, px, py, cover);
 
         if (cover == 0)
             break;
@@ -1469,6 +1487,7 @@ YFrameWindow *YWindowManager::manageClient(Window win, bool mapClient) {
 
     grabServer();
     lockWorkArea();
+    YClientProperties prefetch;
 #if 0
     XSync(xapp->display(), False);
     {
@@ -1492,6 +1511,7 @@ YFrameWindow *YWindowManager::manageClient(Window win, bool mapClient) {
         if (!mapClient && attributes.map_state == IsUnmapped)
             goto end;
 
+        prefetch.request(win, true);
         client = new YFrameClient(0, 0, win);
         if (client == 0)
             goto end;
@@ -1515,6 +1535,7 @@ YFrameWindow *YWindowManager::manageClient(Window win, bool mapClient) {
 
         client->setBorder(attributes.border_width);
     }
+    prefetch.request(win, false);
 
     MSG(("initial geometry 1 (%d:%d %dx%d)",
          client->x(), client->y(), client->width(), client->height()));
@@ -1937,7 +1958,93 @@ void YWindowManager::updateFullscreenLayer() { /// HACK !!!
     }
 }
 
+// Restacks are sent once per event loop turn by flushRestack.
 void YWindowManager::restackWindows(YFrameWindow *) {
+    fRestackPending = true;
+    ++fRestackRequests;
+}
+
+// Forget the stacking order which the server has, after a window
+// was restacked without restackWindows.
+void YWindowManager::invalidateStacking() {
+    fRestackSent.clear();
+    fRestackPending = true;
+}
+
+struct StackIndex {
+    Window window;
+    int index;
+};
+
+static int compareStackIndex(const void* p1, const void* p2) {
+    const Window w1 = static_cast<const StackIndex*>(p1)->window;
+    const Window w2 = static_cast<const StackIndex*>(p2)->window;
+    return w1 < w2 ? -1 : w1 > w2;
+}
+
+// For each window the index in the previous order, or -1.
+static void previousIndices(const YArray<Window>& sent,
+                            const YArray<Window>& w, YArray<int>& prev)
+{
+    const int count = sent.getCount();
+    StackIndex* sorted = new StackIndex[count];
+    for (int i = 0; i < count; ++i) {
+        sorted[i].window = sent[i];
+        sorted[i].index = i;
+    }
+    qsort(sorted, count, sizeof(StackIndex), compareStackIndex);
+
+    for (int i = 0; i < w.getCount(); ++i) {
+        StackIndex key = { w[i], 0 };
+        const void* found = bsearch(&key, sorted, count, sizeof(StackIndex),
+                                    compareStackIndex);
+        prev.append(found ? static_cast<const StackIndex*>(found)->index : -1);
+    }
+    delete[] sorted;
+}
+
+// Mark the longest run of windows, not necessarily adjacent, which
+// keep their previous order below the first window.  These windows
+// stay where they are and the others are moved between them.
+static void unmovedWindows(const YArray<int>& prev, int first,
+                           YArray<bool>& keep)
+{
+    const int count = prev.getCount();
+    YArray<int> tails;          // per length, the position of the least tail
+    YArray<int> links;          // per position, the previous position
+    for (int i = 0; i < count; ++i)
+        links.append(-1);
+
+    for (int i = first; i < count; ++i) {
+        if (prev[i] <= prev[0])
+            continue;
+        int lo = 0, hi = tails.getCount();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (prev[tails[mid]] < prev[i])
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        links[i] = lo > 0 ? tails[lo - 1] : -1;
+        if (lo == tails.getCount())
+            tails.append(i);
+        else
+            tails[lo] = i;
+    }
+
+    for (int i = 0; i < count; ++i)
+        keep.append(i == 0);
+    for (int i = tails.getCount() ? tails[tails.getCount() - 1] : -1;
+         i >= 0; i = links[i])
+        keep[i] = true;
+}
+
+void YWindowManager::flushRestack() {
+    if (fRestackPending == false)
+        return;
+    fRestackPending = false;
+
     int count = focusedCount();
 
     count++; // permanent top window
@@ -1965,12 +2072,48 @@ void YWindowManager::restackWindows(YFrameWindow *) {
     if (statusMoveSize && statusMoveSize->visible())
         w.append(statusMoveSize->handle());
 
+    // The windows above are raised directly, so they are always sent.
+    const int first = w.getCount();
+
     for (YFrameWindow* f = topLayer(); f; f = f->nextLayer()) {
         w.append(f->handle());
     }
 
-    if (w.getCount() > 1) {
+    if (w.getCount() <= 1)
+        return;
+    ++fRestackFlushes;
+    fRestackListed += w.getCount();
+
+    YArray<int> prev;
+    previousIndices(fRestackSent, w, prev);
+    if (prev[0] < 0) {
         XRestackWindows(xapp->display(), &*w, w.getCount());
+        ++fRestackFull;
+        fRestackMoves += w.getCount() - 1;
+    } else {
+        YArray<bool> keep;
+        unmovedWindows(prev, first, keep);
+        for (int i = 1; i < w.getCount(); ++i) {
+            if (keep[i] == false) {
+                XWindowChanges xwc;
+                xwc.sibling = w[i - 1];
+                xwc.stack_mode = Below;
+                XConfigureWindow(xapp->display(), w[i],
+                                 CWSibling | CWStackMode, &xwc);
+                ++fRestackMoves;
+            }
+        }
+    }
+
+    fRestackSent.swap(w);
+}
+
+void YWindowManager::restackStatistics() {
+    if (fRestackFlushes) {
+        tlog("restack: %lu requests, %lu sent, %lu full"
+             ", %lu of %lu windows moved",
+             fRestackRequests, fRestackFlushes, fRestackFull,
+             fRestackMoves, fRestackListed);
     }
 }
 
@@ -2354,6 +2497,7 @@ void YWindowManager::activateWorkspace(long workspace) {
         }
         fLastWorkspace = fActiveWorkspace;
         fActiveWorkspace = workspace;
+        releaseSnapGrid();
         if (taskBar) {
             taskBar->setWorkspaceActive(fActiveWorkspace, true);
         }
@@ -2910,7 +3054,12 @@ void YWindowManager::handleProperty(const XPropertyEvent &property) {
     }
 }
 
+// The lists are written once per event loop turn by flushClientList.
 void YWindowManager::updateClientList() {
+    checkLogout();
+}
+
+void YWindowManager::flushClientList() {
     YArray<XID> ids;
     if (fLayeredUpdated || fCreatedUpdated) {
         ids.setCapacity(fCreationOrder.count());
@@ -2930,18 +3079,9 @@ void YWindowManager::updateClientList() {
             }
         }
 
-        XChangeProperty(xapp->display(), desktop->handle(),
-                        _XA_WIN_CLIENT_LIST,
-                        XA_CARDINAL,
-                        32, PropModeReplace,
-                        ids.getCount() ? (unsigned char *) &*ids : 0,
-                        ids.getCount());
-        XChangeProperty(xapp->display(), desktop->handle(),
-                        _XA_NET_CLIENT_LIST_STACKING,
-                        XA_WINDOW,
-                        32, PropModeReplace,
-                        ids.getCount() ? (unsigned char *) &*ids : 0,
-                        ids.getCount());
+        changeClientList(fStackingList, ids,
+                         _XA_NET_CLIENT_LIST_STACKING, XA_WINDOW,
+                         _XA_WIN_CLIENT_LIST);
     }
 
     if (fCreatedUpdated) {
@@ -2953,14 +3093,50 @@ void YWindowManager::updateClientList() {
                 ids.append(frame->client()->handle());
         }
 
-        XChangeProperty(xapp->display(), desktop->handle(),
-                        _XA_NET_CLIENT_LIST,
-                        XA_WINDOW,
-                        32, PropModeReplace,
-                        ids.getCount() ? (unsigned char *) &*ids : 0,
-                        ids.getCount());
+        changeClientList(fCreationList, ids, _XA_NET_CLIENT_LIST, XA_WINDOW);
+    }
+}
+
+// Write a client list only when it changed, and when windows were
+// only added at the end, append just those.  The other property is
+// the old _WIN_CLIENT_LIST, which mirrors the stacking order.
+bool YWindowManager::changeClientList(YArray<XID>& last, YArray<XID>& ids,
+                                      Atom property, Atom type, Atom other)
+{
+    const int count = ids.getCount();
+    int same = 0;
+    while (same < count && same < last.getCount() && ids[same] == last[same])
+        ++same;
+    if (same == count && same == last.getCount()) {
+        ++fClientListSkips;
+        return false;
+    }
+
+    int start = (same == last.getCount() && same > 0) ? same : 0;
+    int mode = start ? PropModeAppend : PropModeReplace;
+    unsigned char* data = count > start ? (unsigned char *) &ids[start] : 0;
+    XChangeProperty(xapp->display(), desktop->handle(), property,
+                    type, 32, mode, data, count - start);
+    if (other != None) {
+        XChangeProperty(xapp->display(), desktop->handle(), other,
+                        XA_CARDINAL, 32, mode, data, count - start);
+    }
+    fClientListBytes += 4UL * (count - start) * (other != None ? 2 : 1);
+    fClientListWrites += 1;
+    fClientListAppends += (start > 0);
+
+    last.shrink(0);
+    for (int i = 0; i < count; ++i)
+        last.append(ids[i]);
+    return true;
+}
+
+void YWindowManager::clientListStatistics() {
+    if (fClientListWrites + fClientListSkips) {
+        tlog("client list: %lu writes, %lu appends, %lu unchanged"
+             ", %lu bytes", fClientListWrites, fClientListAppends,
+             fClientListSkips, fClientListBytes);
     }
-    checkLogout();
 }
 
 void YWindowManager::updateUserTime(const UserTime& userTime) {
@@ -3000,7 +3176,35 @@ void YWindowManager::checkLogout() {
     }
 }
 
+// Frames do not move while another frame is moved, so the grid
+// is kept until the move ends or the workspace changes.
+const YRectGrid& YWindowManager::snapGrid(YFrameWindow *frame) {
+    if (fSnapGrid == 0 || fSnapFrame != frame) {
+        releaseSnapGrid();
+        fSnapGrid = new YRectGrid;
+        fSnapFrame = frame;
+        for (YFrameWindow *f = topLayer(); f; f = f->nextLayer()) {
+            if (frame->affectsWorkArea() && f->inWorkArea())
+                continue;
+            if (f != frame && f->visible())
+                fSnapGrid->add(f->geometry());
+        }
+        fSnapGrid->build();
+    }
+    return *fSnapGrid;
+}
+
+void YWindowManager::releaseSnapGrid() {
+    delete fSnapGrid;
+    fSnapGrid = 0;
+    fSnapFrame = 0;
+}
+
 void YWindowManager::removeClientFrame(YFrameWindow *frame) {
+    releaseSnapGrid();
+    int sent = find(fRestackSent, frame->handle());
+    if (sent >= 0)
+        fRestackSent.remove(sent);
     if (fArrangeInfo) {
         for (int i = 0; i < fArrangeCount; i++)
             if (fArrangeInfo[i].frame == frame)
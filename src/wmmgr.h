@@ -9,6 +9,7 @@ extern YAction layerActionSet[WinLayerCount];
 
 class YStringList;
 class YWindowManager;
+class YRectGrid;
 class YFrameClient;
 class YFrameWindow;
 class YSMListener;
@@ -134,13 +135,17 @@ public:
 
     void removeClientFrame(YFrameWindow *frame);
 
+    // The frames to which a moving frame can snap, from top to bottom.
+    const YRectGrid& snapGrid(YFrameWindow *frame);
+    void releaseSnapGrid();
+
     void UpdateScreenSize(XEvent *event);
     void getWorkArea(YFrameWindow *frame, int *mx, int *my, int *Mx, int *My, int xiscreen = -1) const;
     void getWorkAreaSize(YFrameWindow *frame, int *Mw,int *Mh);
 
-    int calcCoverage(bool down, YFrameWindow *frame, int x, int y, int w, int h);
-    void tryCover(bool down, YFrameWindow *frame, int x, int y, int w, int h,
-                  int &px, int &py, int &cover, int xiscreen);
+    int calcCoverage(bool down, const YRectGrid& covers, int x, int y, int w, int h);
+    void tryCover(bool down, const YRectGrid& covers, const YRect& area,
+                  int x, int y, int w, int h, int &px, int &py, int &cover);
     bool getSmartPlace(bool down, YFrameWindow *frame, int &x, int &y, int w, int h, int xiscreen);
     void getNewPosition(YFrameWindow *frame, int &x, int &y, int w, int h, int xiscreen);
     void placeWindow(YFrameWindow *frame, int x, int y, int cw, int ch, bool newClient, bool &canActivate);
@@ -168,6 +173,9 @@ public:
     void raiseFocusFrame(YFrameWindow* frame);
 
     void restackWindows(YFrameWindow *win);
+    void flushRestack();
+    void invalidateStacking();
+    void restackStatistics();
     void focusTopWindow();
     YFrameWindow *getFrameUnderMouse(long workspace = -1);
     YFrameWindow *getLastFocus(bool skipAllWorkspaces = false, long workspace = -1);
@@ -175,6 +183,8 @@ public:
     bool focusTop(YFrameWindow *f);
     void relocateWindows(long workspace, int screen, int dx, int dy);
     void updateClientList();
+    void flushClientList();
+    void clientListStatistics();
     void updateUserTime(const UserTime& userTime);
 
     YMenu *createWindowMenu(YMenu *menu, long workspace);
@@ -361,6 +371,28 @@ private:
     bool fCreatedUpdated;
     bool fLayeredUpdated;
 
+    // The client lists as last written to the root window.
+    YArray<XID> fStackingList;
+    YArray<XID> fCreationList;
+    unsigned long fClientListBytes;
+    unsigned long fClientListWrites;
+    unsigned long fClientListAppends;
+    unsigned long fClientListSkips;
+    YRectGrid *fSnapGrid;
+    YFrameWindow *fSnapFrame;
+
+    // The stacking order as last sent to the server.
+    YArray<Window> fRestackSent;
+    bool fRestackPending;
+    unsigned long fRestackRequests;
+    unsigned long fRestackFlushes;
+    unsigned long fRestackFull;
+    unsigned long fRestackMoves;
+    unsigned long fRestackListed;
+
+    bool changeClientList(YArray<XID>& last, YArray<XID>& ids,
+                          Atom property, Atom type, Atom other = None);
+
     DesktopLayout fLayout;
 };
 
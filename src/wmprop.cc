@@ -0,0 +1,309 @@
+/*
+ * IceWM - prefetch the properties of a new client window
+ */
+#include "config.h"
+#include "yfull.h"
+#include "yxapp.h"
+#include "ymenu.h"
+#include "wmmgr.h"
+#include "wmprop.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef CONFIG_XCB
+#include <X11/Xlib-xcb.h>
+#endif
+
+// The properties which a new client is asked for while it is managed,
+// with the length and type which the YFrameClient getters request.
+// Without a type atom the property itself is the requested type.
+// Early properties are read by the YFrameClient constructor.
+static const struct Prefetch {
+    Atom* property;
+    long length;
+    Atom type;
+    Atom* typeAtom;
+    bool early;
+} prefetches[] = {
+    { &_XA_WM_STATE,                    2,          None, &_XA_WM_STATE, false },
+    { &_XA_WM_CLIENT_LEADER,            1,          XA_WINDOW, 0, false },
+    { &_XA_WM_WINDOW_ROLE,              256,        XA_STRING, 0, true },
+    { &_XA_WINDOW_ROLE,                 256,        XA_STRING, 0, true },
+    { &_XATOM_MWM_HINTS,                20,         None, &_XATOM_MWM_HINTS, true },
+    { &_XA_KWM_WIN_ICON,                2,          None, &_XA_KWM_WIN_ICON, false },
+    { &_XA_NET_WM_ICON,                 1024*256,   AnyPropertyType, 0, false },
+    { &_XA_NET_WM_PID,                  1,          XA_CARDINAL, 0, false },
+    { &_XA_NET_WM_STATE,                64,         XA_ATOM, 0, false },
+    { &_XA_NET_WM_WINDOW_TYPE,          64,         AnyPropertyType, 0, false },
+    { &_XA_NET_WM_STRUT,                4,          XA_CARDINAL, 0, false },
+    { &_XA_NET_WM_STRUT_PARTIAL,        12,         XA_CARDINAL, 0, false },
+    { &_XA_NET_WM_DESKTOP,              1,          XA_CARDINAL, 0, false },
+    { &_XA_NET_WM_USER_TIME,            1,          XA_CARDINAL, 0, false },
+    { &_XA_NET_WM_USER_TIME_WINDOW,     1,          XA_WINDOW, 0, false },
+    { &_XA_NET_WM_WINDOW_OPACITY,       1,          XA_CARDINAL, 0, false },
+    { &_XA_WIN_HINTS,                   1,          XA_CARDINAL, 0, true },
+    { &_XA_WIN_ICONS,                   4096,       AnyPropertyType, 0, false },
+    { &_XA_WIN_LAYER,                   1,          XA_CARDINAL, 0, false },
+    { &_XA_WIN_STATE,                   2,          XA_CARDINAL, 0, false },
+    { &_XA_WIN_TRAY,                    1,          XA_CARDINAL, 0, false },
+    { &_XA_WIN_WORKSPACE,               1,          XA_CARDINAL, 0, false },
+};
+
+struct YClientProperties::Request {
+    Atom property;
+    long length;
+    Atom type;
+    unsigned sequence;
+    void* reply;
+    bool pending;
+};
+
+YClientProperties* YClientProperties::fActive;
+int YClientProperties::fRoundTrips;
+unsigned long YClientProperties::fManaged;
+unsigned long YClientProperties::fTotalTrips;
+unsigned long YClientProperties::fAnswered;
+
+YClientProperties::YClientProperties():
+    fWindow(None),
+    fRequests(0),
+    fCount(0),
+    fListing(0),
+    fList(0),
+    fListPending(false),
+    fListChanged(false),
+    fPrevious(fActive)
+{
+    fActive = this;
+    fRoundTrips = 0;
+}
+
+// Send the requests for the early or the remaining properties.
+void YClientProperties::request(Window window, bool early) {
+    fWindow = window;
+#ifdef CONFIG_XCB
+    xcb_connection_t* conn = XGetXCBConnection(xapp->display());
+    const int count = int ACOUNT(prefetches);
+    if (fRequests == 0)
+        fRequests = new Request[count];
+    if (early) {
+        fListing = xcb_list_properties(conn, window).sequence;
+        fListPending = true;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (prefetches[i].early != early)
+            continue;
+        Request& r = fRequests[fCount++];
+        r.property = *prefetches[i].property;
+        r.length = prefetches[i].length;
+        r.type = prefetches[i].typeAtom ? *prefetches[i].typeAtom
+                                        : prefetches[i].type;
+        r.sequence = xcb_get_property(conn, False, window, r.property,
+                                      r.type, 0, r.length).sequence;
+        r.reply = 0;
+        r.pending = true;
+    }
+    xcb_flush(conn);
+#endif
+}
+
+YClientProperties::~YClientProperties() {
+#ifdef CONFIG_XCB
+    xcb_connection_t* conn = XGetXCBConnection(xapp->display());
+    if (fListPending)
+        xcb_discard_reply(conn, fListing);
+    for (int i = 0; i < fCount; ++i)
+        if (fRequests[i].pending)
+            xcb_discard_reply(conn, fRequests[i].sequence);
+#endif
+    for (int i = 0; i < fCount; ++i)
+        free(fRequests[i].reply);
+    delete[] fRequests;
+    free(fList);
+
+    MSG(("managed 0x%lX with %d property round trips",
+         fWindow, fRoundTrips));
+    fManaged += 1;
+    fTotalTrips += fRoundTrips;
+    fActive = fPrevious;
+}
+
+// Collect the replies to all requests which are still pending.
+void YClientProperties::receive() {
+#ifdef CONFIG_XCB
+    xcb_connection_t* conn = XGetXCBConnection(xapp->display());
+    xcb_generic_error_t* error = 0;
+    if (fListPending) {
+        xcb_list_properties_cookie_t listing = { fListing };
+        fList = xcb_list_properties_reply(conn, listing, &error);
+        fListPending = false;
+        free(error);
+    }
+    for (int i = 0; i < fCount; ++i) {
+        Request& r = fRequests[i];
+        if (r.pending) {
+            xcb_get_property_cookie_t cookie = { r.sequence };
+            error = 0;
+            r.reply = xcb_get_property_reply(conn, cookie, &error);
+            r.pending = false;
+            free(error);
+        }
+    }
+    countRoundTrip();
+#endif
+}
+
+// icewm wrote a property, so its prefetched reply is stale.
+void YClientProperties::changed(Window window, Atom property) {
+    for (YClientProperties* p = fActive; p; p = p->fPrevious) {
+        if (p->fWindow == window) {
+            p->fListChanged = true;
+            for (int i = 0; i < p->fCount; ++i)
+                if (p->fRequests[i].property == property)
+                    p->fRequests[i].property = None;
+        }
+    }
+}
+
+Atom* YClientProperties::listProperties(Window window, int* count) {
+    if (window != fWindow || fListing == 0 || fListChanged)
+        return 0;
+    if (fListPending)
+        receive();
+#ifdef CONFIG_XCB
+    xcb_list_properties_reply_t* list =
+        static_cast<xcb_list_properties_reply_t *>(fList);
+    if (list) {
+        int n = xcb_list_properties_atoms_length(list);
+        xcb_atom_t* atoms = xcb_list_properties_atoms(list);
+        Atom* result = (Atom *) malloc((n + 1) * sizeof(Atom));
+        for (int i = 0; result && i < n; ++i)
+            result[i] = atoms[i];
+        *count = n;
+        ++fAnswered;
+        return result;
+    }
+#endif
+    return 0;
+}
+
+// Answer exactly as XGetWindowProperty would, or return false.
+bool YClientProperties::getProperty(Window window, Atom property,
+                                    long offset, long length, Bool remove,
+                                    Atom type, Atom* actualType,
+                                    int* actualFormat, unsigned long* count,
+                                    unsigned long* remain,
+                                    unsigned char** data)
+{
+    if (window != fWindow || offset != 0 || remove)
+        return false;
+    for (int i = 0; i < fCount; ++i) {
+        const Request& r = fRequests[i];
+        if (r.property != property || r.type != type)
+            continue;
+        if (r.pending)
+            receive();
+#ifdef CONFIG_XCB
+        xcb_get_property_reply_t* reply =
+            static_cast<xcb_get_property_reply_t *>(r.reply);
+        if (reply == 0)
+            return false;
+        // A different length is only equivalent when all data is here.
+        unsigned long bytes = xcb_get_property_value_length(reply);
+        if (length != r.length &&
+            (reply->bytes_after || 4UL * length < bytes))
+            return false;
+
+        unsigned long items = reply->value_len;
+        unsigned char* value = 0;
+        if (reply->type != None) {
+            const void* source = xcb_get_property_value(reply);
+            if (reply->format == 8) {
+                value = (unsigned char *) malloc(items + 1);
+                if (value)
+                    memcpy(value, source, items);
+                bytes = items;
+            }
+            else if (reply->format == 16) {
+                bytes = items * sizeof(short);
+                value = (unsigned char *) malloc(bytes + 1);
+                if (value)
+                    memcpy(value, source, bytes);
+            }
+            else if (reply->format == 32) {
+                bytes = items * sizeof(long);
+                value = (unsigned char *) malloc(bytes + 1);
+                const int32_t* in = static_cast<const int32_t *>(source);
+                long* out = (long *) value;
+                for (unsigned long k = 0; value && k < items; ++k)
+                    out[k] = in[k];
+            }
+            else
+                return false;
+            if (value == 0)
+                return false;
+            value[bytes] = '\0';
+        }
+        *actualType = reply->type;
+        *actualFormat = reply->format;
+        *count = items;
+        *remain = reply->bytes_after;
+        *data = value;
+        ++fAnswered;
+        return true;
+#endif
+    }
+    return false;
+}
+
+void YClientProperties::statistics() {
+    if (fManaged) {
+        tlog("manage: %lu windows, %.1f property round trips each"
+             ", %lu replies prefetched",
+             fManaged, double(fTotalTrips) / fManaged, fAnswered);
+    }
+}
+
+Atom* fetchPropertyList(Display* display, Window window, int* count) {
+    YClientProperties* prefetch = YClientProperties::active();
+    if (prefetch) {
+        Atom* atoms = prefetch->listProperties(window, count);
+        if (atoms)
+            return atoms;
+    }
+    YClientProperties::countRoundTrip();
+    return XListProperties(display, window, count);
+}
+
+int fetchWindowProperty(Display* display, Window window, Atom property,
+                        long offset, long length, Bool remove, Atom type,
+                        Atom* actualType, int* actualFormat,
+                        unsigned long* count, unsigned long* remain,
+                        unsigned char** data)
+{
+    YClientProperties* prefetch = YClientProperties::active();
+    if (prefetch && prefetch->getProperty(window, property, offset, length,
+                                          remove, type, actualType,
+                                          actualFormat, count, remain, data))
+        return Success;
+    YClientProperties::countRoundTrip();
+    return XGetWindowProperty(display, window, property, offset, length,
+                              remove, type, actualType, actualFormat,
+                              count, remain, data);
+}
+
+int changeWindowProperty(Display* display, Window window, Atom property,
+                         Atom type, int format, int mode,
+                         const unsigned char* data, int count)
+{
+    YClientProperties::changed(window, property);
+    return XChangeProperty(display, window, property, type, format, mode,
+                           data, count);
+}
+
+int deleteWindowProperty(Display* display, Window window, Atom property) {
+    YClientProperties::changed(window, property);
+    return XDeleteProperty(display, window, property);
+}
+
+// vim: set sw=4 ts=4 et:
@@ -0,0 +1,66 @@
+#ifndef WMPROP_H
+#define WMPROP_H
+
+/*
+ * While a new client window is managed, the properties which icewm
+ * reads are requested together, so their replies arrive in a single
+ * round trip.  The fetch functions below behave like XListProperties
+ * and XGetWindowProperty, but use those replies when they can.
+ * The change functions drop replies which icewm made stale.
+ */
+class YClientProperties {
+public:
+    YClientProperties();
+    ~YClientProperties();
+
+    void request(Window window, bool early);
+    Atom* listProperties(Window window, int* count);
+    bool getProperty(Window window, Atom property, long offset,
+                     long length, Bool remove, Atom type,
+                     Atom* actualType, int* actualFormat,
+                     unsigned long* count, unsigned long* remain,
+                     unsigned char** data);
+
+    static YClientProperties* active() { return fActive; }
+    static int roundTrips() { return fRoundTrips; }
+    static void countRoundTrip() { ++fRoundTrips; }
+    static void changed(Window window, Atom property);
+    static void statistics();
+
+private:
+    YClientProperties(const YClientProperties&);
+    YClientProperties& operator=(const YClientProperties&);
+
+    void receive();
+
+    struct Request;
+    Window fWindow;
+    Request* fRequests;
+    int fCount;
+    unsigned fListing;
+    void* fList;
+    bool fListPending;
+    bool fListChanged;
+    YClientProperties* fPrevious;
+
+    static YClientProperties* fActive;
+    static int fRoundTrips;
+    static unsigned long fManaged;
+    static unsigned long fTotalTrips;
+    static unsigned long fAnswered;
+};
+
+Atom* fetchPropertyList(Display* display, Window window, int* count);
+int fetchWindowProperty(Display* display, Window window, Atom property,
+                        long offset, long length, Bool remove, Atom type,
+                        Atom* actualType, int* actualFormat,
+                        unsigned long* count, unsigned long* remain,
+                        unsigned char** data);
+int changeWindowProperty(Display* display, Window window, Atom property,
+                         Atom type, int format, int mode,
+                         const unsigned char* data, int count);
+int deleteWindowProperty(Display* display, Window window, Atom property);
+
+#endif
+
+// vim: set sw=4 ts=4 et:
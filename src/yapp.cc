@@ -16,6 +16,13 @@
 #ifdef USE_SIGNALFD
 #include <sys/signalfd.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#if defined(HAVE_SYS_TIMERFD_H) && defined(_POSIX_MONOTONIC_CLOCK)
+#include <sys/timerfd.h>
+#define USE_TIMERFD
+#endif
 #include <pwd.h>
 
 IMainLoop *mainLoop;
@@ -26,6 +33,203 @@ static sigset_t signalMask;
 IApp::~IApp() {}
 IMainLoop::~IMainLoop() {}
 
+/*
+ * A poll set multiplexes the file descriptors of the registered polls.
+ */
+class YPollSet {
+public:
+    virtual ~YPollSet() {}
+
+    virtual void registerPoll(YPollBase *t) = 0;
+    virtual void unregisterPoll(YPollBase *t) = 0;
+
+    // Wait for readiness: the number of ready descriptors,
+    // zero on timeout, or -1 on error.
+    virtual int wait(timeval *timeout) = 0;
+
+    // Notify the polls which were found ready by wait.
+    virtual void dispatch() = 0;
+};
+
+/*
+ * The portable fallback: rebuild the descriptor sets for each select.
+ */
+class YSelectPollSet: public YPollSet {
+public:
+    YSelectPollSet() {
+        FD_ZERO(&readFds);
+        FD_ZERO(&writeFds);
+    }
+
+    virtual void registerPoll(YPollBase *t) {
+        if (t->fd() >= FD_SETSIZE) {
+            warn("File descriptor %d exceeds FD_SETSIZE and is ignored",
+                 t->fd());
+        }
+        else if (find(polls, t) < 0) {
+            polls.append(t);
+        }
+    }
+
+    virtual void unregisterPoll(YPollBase *t) {
+        int k = find(polls, t);
+        if (k >= 0)
+            polls.remove(k);
+    }
+
+    virtual int wait(timeval *timeout) {
+        FD_ZERO(&readFds);
+        FD_ZERO(&writeFds);
+
+        int maxFd = -1;
+        YArrayIterator<YPollBase*> iPoll = polls.iterator();
+        while (++iPoll) {
+            PRECONDITION(iPoll->fd() >= 0);
+            if (iPoll->forRead()) {
+                FD_SET(iPoll->fd(), &readFds);
+                maxFd = max(maxFd, iPoll->fd());
+            }
+            if (iPoll->forWrite()) {
+                FD_SET(iPoll->fd(), &writeFds);
+                maxFd = max(maxFd, iPoll->fd());
+            }
+        }
+
+        return select(maxFd + 1,
+                      SELECT_TYPE_ARG234 &readFds,
+                      SELECT_TYPE_ARG234 &writeFds,
+                      0,
+                      timeout);
+    }
+
+    virtual void dispatch() {
+        // copy, because a nested main loop may select again
+        fd_set read_fds(readFds);
+        fd_set write_fds(writeFds);
+
+        YArrayIterator<YPollBase*> iPoll = polls.reverseIterator();
+        while (++iPoll) {
+            if (iPoll->fd() >= 0 && FD_ISSET(iPoll->fd(), &read_fds)) {
+                iPoll->notifyRead();
+                if (iPoll.isValid() == false)
+                    continue;
+            }
+            if (iPoll->fd() >= 0 && FD_ISSET(iPoll->fd(), &write_fds)) {
+                iPoll->notifyWrite();
+            }
+        }
+    }
+
+private:
+    YArray<YPollBase*> polls;
+    fd_set readFds;
+    fd_set writeFds;
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * Keep the interest set in the kernel and update it incrementally.
+ * Only the ready polls are visited, regardless of how many
+ * descriptors are registered, and without an FD_SETSIZE limit.
+ */
+class YEpollSet: public YPollSet {
+public:
+    explicit YEpollSet(int epfd): epfd(epfd), count(0) { }
+    virtual ~YEpollSet() { close(epfd); }
+
+    static YEpollSet* create() {
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd == -1) {
+            fail("epoll_create1");
+            return 0;
+        }
+        return new YEpollSet(epfd);
+    }
+
+    virtual void registerPoll(YPollBase *t) {
+        epoll_event ev;
+        ev.events = (t->forRead() ? unsigned(EPOLLIN) : 0U) |
+                    (t->forWrite() ? unsigned(EPOLLOUT) : 0U);
+        ev.data.ptr = t;
+
+        // Hangups are always reported, so an idle poll must not be
+        // in the kernel set, or we would spin on it.
+        if (ev.events == 0) {
+            unregisterPoll(t);
+        }
+        else if (epoll_ctl(epfd, EPOLL_CTL_ADD, t->fd(), &ev) == -1) {
+            if (errno != EEXIST ||
+                epoll_ctl(epfd, EPOLL_CTL_MOD, t->fd(), &ev) == -1)
+                fail("epoll_ctl %d", t->fd());
+        }
+    }
+
+    virtual void unregisterPoll(YPollBase *t) {
+        epoll_event ev = {};
+        if (epoll_ctl(epfd, EPOLL_CTL_DEL, t->fd(), &ev) == -1) {
+            if (errno != ENOENT && errno != EBADF)
+                fail("epoll_ctl %d", t->fd());
+        }
+        // a pending event must not be delivered to this poll anymore
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.ptr == t)
+                events[i].data.ptr = 0;
+        }
+    }
+
+    virtual int wait(timeval *timeout) {
+        int msec = -1;
+        if (timeout) {
+            msec = int(timeout->tv_sec * 1000L +
+                       (timeout->tv_usec + 999L) / 1000L);
+        }
+        count = epoll_wait(epfd, events, int ACOUNT(events), msec);
+        if (count == -1) {
+            int error = errno;
+            count = 0;
+            errno = error;
+            return -1;
+        }
+        return count;
+    }
+
+    virtual void dispatch() {
+        // A nested main loop resets count, which ends this loop.
+        for (int i = 0; i < count; ++i) {
+            YPollBase *t = static_cast<YPollBase *>(events[i].data.ptr);
+            if (t == 0)
+                continue;
+
+            const unsigned ready = events[i].events;
+            if ((ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) && t->forRead()) {
+                t->notifyRead();
+                if (i >= count || events[i].data.ptr == 0)
+                    continue;
+            }
+            if ((ready & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && t->forWrite()) {
+                t->notifyWrite();
+            }
+        }
+        count = 0;
+    }
+
+private:
+    int epfd;
+    int count;
+    epoll_event events[32];
+};
+#endif
+
+static YPollSet* createPollSet() {
+    YPollSet *set = 0;
+#ifdef HAVE_SYS_EPOLL_H
+    set = YEpollSet::create();
+#endif
+    if (set == 0)
+        set = new YSelectPollSet();
+    return set;
+}
+
 void YApplication::initSignals() {
     sigemptyset(&signalMask);
     sigaddset(&signalMask, SIGHUP);
@@ -60,136 +264,76 @@ void alrm_handler(int /*sig*/) {
 
 YApplication::YApplication(int * /*argc*/, char *** /*argv*/) {
     ::mainLoop = this;
+    polls = createPollSet();
 
     fLoopLevel = 0;
     fExitApp = 0;
 
+    fWakeups = 0;
+    fWakeupsPerMinute = 0;
+    fWakeupMinute = monotime();
+
     setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
     setvbuf(stderr, NULL, _IOLBF, BUFSIZ);
 
     initSignals();
+    tfd.create(this);
 }
 
 YApplication::~YApplication() {
+    tfd.destroy();
     sfd.unregisterPoll();
+    delete polls;
     ::mainLoop = 0;
 }
 
 void YApplication::registerTimer(YTimer *t) {
-    if (find(timers, t) < 0)
-        timers.append(t);
+    timers.schedule(t);
 }
 
 void YApplication::unregisterTimer(YTimer *t) {
-    int k = find(timers, t);
-    if (k >= 0)
-        timers.remove(k);
+    timers.cancel(t);
 }
 
 bool YApplication::nextTimeout(timeval *timeout) {
-    bool fFirst = true;
-    YArrayIterator<YTimer*> t = timers.iterator();
-    while (++t) {
-        if (t->isRunning() && (fFirst || t->timeout < *timeout)) {
-            *timeout = t->timeout;
-            fFirst = false;
-        }
-    }
-    return fFirst == false;
-}
-
-bool YApplication::nextTimeoutWithFuzziness(timeval *timeout) {
-    bool fixedExists = false;
-    timeval timeout_fixed = {0, 0L};
-
-    bool fuzzyExists = false;
-    timeval timeout_fuzzy = {0, 0L};
-    timeval timeout_max = {0, 0L};
-
-    for (YArrayIterator<YTimer*> iter = timers.iterator(); ++iter; ) {
-        if (iter->isRunning()) {
-            if (iter->isFixed()) {
-                // Update if no fixed timer yet or current
-                // is earlier than previously registered one.
-                if (false == fixedExists || iter->timeout < timeout_fixed) {
-                    timeout_fixed = iter->timeout;
-                    fixedExists = true;
-                }
-            }
-            else if (false == fuzzyExists) {
-                // encountered first fuzzy timer, register everything
-                timeout_fuzzy = iter->timeout;
-                timeout_max = iter->timeout_max;
-                fuzzyExists = true;
-            }
-            else if (iter->timeout < timeout_fuzzy) {
-                // this fuzzy timer is earlier than previous one
-                timeout_fuzzy = iter->timeout;
-                if (iter->timeout_max < timeout_max)
-                    timeout_max = iter->timeout_max;
-            }
-        }
-    }
-
-    if (fixedExists && fuzzyExists)
-        *timeout = min(timeout_max, timeout_fixed);
-    else if (fixedExists)
-        *timeout = timeout_fixed;
-    else if (fuzzyExists)
-        *timeout = timeout_max;
-    return fixedExists | fuzzyExists;
+    // Without fuzziness the latest timeout equals the timeout.
+    // With fuzziness we wait as long as all timers permit,
+    // to handle as many timers as possible in one wakeup.
+    return timers.deadline(timeout);
 }
 
 bool YApplication::getTimeout(timeval *timeout) {
-    bool found = false;
-    if (0 < timers.getCount()) {
-        timeval tval = {0, 0L};
-        if (inrange(DelayFuzziness, 1, 100))
-            found = nextTimeoutWithFuzziness(&tval);
-        else
-            found = nextTimeout(&tval);
-        if (found)
-            *timeout = max(tval - monotime(), (timeval) { 0L, 1L });
-    }
+    timeval tval = {0, 0L};
+    bool found = nextTimeout(&tval);
+    if (found)
+        *timeout = max(tval - monotime(), (timeval) { 0L, 1L });
     return found;
 }
 
 void YApplication::handleTimeouts() {
     timeval now = monotime();
-    YTimer *timeout = 0;
-    YArrayIterator<YTimer*> iter = timers.reverseIterator();
-    // we must be careful since the callback may modify the array.
-    while (iter.hasNext()) {
-        if (++iter &&
-            *iter != timeout &&
-            iter->isRunning() &&
-            iter->timeout_min < now)
-        {
-            timeout = *iter;
-            YTimerListener *listener = timeout->getTimerListener();
-            timeout->stopTimer();
-            if (listener && listener->handleTimer(timeout))
-                timeout->startTimer();
-        }
+    // The heap is reconsulted after each handler,
+    // because the handler may start, stop or delete timers.
+    timers.beginExpiry();
+    for (YTimer *timeout; (timeout = timers.expired(now)) != 0; ) {
+        YTimerListener *listener = timeout->getTimerListener();
+        timeout->stopTimer();
+        if (listener && listener->handleTimer(timeout))
+            timeout->startTimer();
     }
 }
 
 void YApplication::decreaseTimeouts(timeval diff) {
-    YArrayIterator<YTimer*> iter = timers.reverseIterator();
-    while (++iter)
-        iter->timeout += diff;
+    timers.shift(diff);
 }
 
 void YApplication::registerPoll(YPollBase *t) {
     PRECONDITION(t->fd() >= 0);
-    if (find(polls, t) < 0)
-        polls.append(t);
+    polls->registerPoll(t);
 }
 
 void YApplication::unregisterPoll(YPollBase *t) {
-    int k = find(polls, t);
-    if (k >= 0)
-        polls.remove(k);
+    polls->unregisterPoll(t);
 }
 
 YPollBase::~YPollBase() {
@@ -223,44 +367,34 @@ int YApplication::mainLoop() {
     for (fExitLoop = fExitApp; (fExitApp | fExitLoop) == false; ) {
         bool didIdle = handleIdle();
 
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        fd_set write_fds;
-        FD_ZERO(&write_fds);
-
-        YArrayIterator<YPollBase*> iPoll = polls.iterator();
-        while (++iPoll) {
-            PRECONDITION(iPoll->fd() >= 0);
-            if (iPoll->forRead()) {
-                FD_SET(iPoll->fd(), &read_fds);
-            }
-            if (iPoll->forWrite()) {
-                FD_SET(iPoll->fd(), &write_fds);
-            }
-        }
-
         timeval timeout = {0, 0L};
         timeval *tp = &timeout;
-        if (!didIdle && getTimeout(tp) == false)
+        timeval deadline;
+        if (didIdle) {
+            // only poll
+        }
+        else if (tfd.fd() >= 0 &&
+                 tfd.arm(nextTimeout(&deadline) ? &deadline : 0)) {
+            // the timerfd wakes us at the deadline
+            tp = 0;
+        }
+        else if (getTimeout(tp) == false)
             tp = 0;
 
 #ifndef USE_SIGNALFD
         sigprocmask(SIG_UNBLOCK, &signalMask, NULL);
 #endif
 
-        int rc;
-        rc = select(sizeof(fd_set) * 8,
-                    SELECT_TYPE_ARG234 &read_fds,
-                    SELECT_TYPE_ARG234 &write_fds,
-                    0,
-                    tp);
+        int rc = polls->wait(tp);
 
 #ifndef USE_SIGNALFD
         sigprocmask(SIG_BLOCK, &signalMask, NULL);
 #endif
 
         {
-            timeval diff = monotime() - prevtime;
+            timeval now = monotime();
+            countWakeup(now);
+            timeval diff = now - prevtime;
             // This is irrelevant when using monotonic clocks:
             // if time travel to past, decrease the timeouts
             if (diff < zerotime()) {
@@ -278,22 +412,26 @@ int YApplication::mainLoop() {
             if (errno != EINTR)
                 fail(_("%s: select failed"), __func__);
         } else {
-            for (iPoll = polls.reverseIterator(); ++iPoll; ) {
-                if (iPoll->fd() >= 0 && FD_ISSET(iPoll->fd(), &read_fds)) {
-                    iPoll->notifyRead();
-                    if (iPoll.isValid() == false)
-                        continue;
-                }
-                if (iPoll->fd() >= 0 && FD_ISSET(iPoll->fd(), &write_fds)) {
-                    iPoll->notifyWrite();
-                }
-            }
+            polls->dispatch();
         }
     }
     fLoopLevel--;
     return fExitCode;
 }
 
+void YApplication::countWakeup(const timeval& now) {
+    ++fWakeups;
+    if (fWakeupMinute + 60L < now) {
+        timeval elapsed = now - fWakeupMinute;
+        if (elapsed < maketime(120L, 0L))
+            fWakeupsPerMinute = int(fWakeups * 60.0 / toDouble(elapsed));
+        else
+            fWakeupsPerMinute = 0;
+        fWakeupMinute = now;
+        fWakeups = 0;
+    }
+}
+
 void YApplication::exitLoop(int exitCode) {
     fExitLoop = 1;
     fExitCode = exitCode;
@@ -443,6 +581,67 @@ void YSignalPoll::notifyRead()
 }
 #endif
 
+bool YTimerPoll::create(YApplication *app) {
+#ifdef USE_TIMERFD
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd >= 0) {
+        registerPoll(app, fd);
+        return true;
+    }
+#endif
+    return false;
+}
+
+void YTimerPoll::destroy() {
+    int fd = fFd;
+    if (fd >= 0) {
+        unregisterPoll();
+        close(fd);
+    }
+}
+
+// On failure the timerfd is closed and the main loop
+// returns to poll timeouts.
+bool YTimerPoll::arm(const timeval *deadline) {
+#ifdef USE_TIMERFD
+    // Only a changed deadline requires a system call.
+    // A zero timeval disarms.
+    timeval expire = deadline ? max(*deadline, maketime(0L, 1L)) : zerotime();
+    if (expire == fArmed)
+        return true;
+
+    itimerspec spec = {};
+    spec.it_value.tv_sec = expire.tv_sec;
+    spec.it_value.tv_nsec = expire.tv_usec * 1000L;
+    if (timerfd_settime(fFd, TFD_TIMER_ABSTIME, &spec, 0) == 0) {
+        fArmed = expire;
+        return true;
+    }
+    fail("timerfd_settime");
+    destroy();
+#endif
+    return false;
+}
+
+void YTimerPoll::notifyRead() {
+    unsigned long long expirations;
+    if (read(fFd, &expirations, sizeof expirations) > 0) {
+        fArmed = zerotime();
+        owner()->handleTimeouts();
+    }
+}
+
+void YTimerPoll::notifyWrite() {
+}
+
+bool YTimerPoll::forRead() {
+    return true;
+}
+
+bool YTimerPoll::forWrite() {
+    return false;
+}
+
 void YSignalPoll::notifyWrite() {
 }
 
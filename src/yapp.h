@@ -4,9 +4,84 @@
 #include "upath.h"
 #include "yarray.h"
 #include "ypoll.h"
+#include "ytimer.h"
 
-class YTimer;
 class YClipboard;
+class YPollSet;
+
+/*
+ * A binary min-heap of timers on one of their time limits.
+ * Each timer records its heap position for O(log n) removal.
+ */
+class YTimerHeap {
+public:
+    enum Limit { Earliest, Latest };
+
+    explicit YTimerHeap(Limit limit): fLimit(limit) { }
+
+    YTimer *top() const { return fHeap.nonempty() ? fHeap[0] : 0; }
+    int getCount() const { return fHeap.getCount(); }
+    YTimer *operator[](int index) const { return fHeap[index]; }
+
+    void insert(YTimer *t);
+    void remove(YTimer *t);
+    void update(YTimer *t);
+
+private:
+    const timeval& key(const YTimer *t) const {
+        return fLimit == Earliest ? t->timeout_min : t->timeout_max;
+    }
+    bool before(const YTimer *a, const YTimer *b) const {
+        return key(a) < key(b);
+    }
+    void place(int index, YTimer *t) {
+        fHeap[index] = t;
+        t->fHeapIndex[fLimit] = index;
+    }
+    void siftUp(int index);
+    void siftDown(int index);
+
+    YArray<YTimer *> fHeap;
+    const Limit fLimit;
+};
+
+/*
+ * The running timers of the main loop. A timer may expire anywhere
+ * between its earliest and latest timeout, which permits coalescing
+ * of fuzzy timers: the main loop sleeps until the first latest timeout,
+ * then handles all timers whose earliest timeout has passed.
+ * Starting, restarting or stopping a timer costs O(log n).
+ */
+class YTimerQueue {
+public:
+    YTimerQueue():
+        fEarliest(YTimerHeap::Earliest),
+        fLatest(YTimerHeap::Latest),
+        fSerial(0)
+    { }
+
+    // insert a timer or reposition it when it was restarted
+    void schedule(YTimer *t);
+    void cancel(YTimer *t);
+
+    // the first latest timeout of all timers
+    bool deadline(timeval *timeout) const;
+
+    // start a new round of handling expired timers
+    void beginExpiry() { ++fSerial; }
+    // an expired timer which wasn't handled in this round yet
+    YTimer *expired(const timeval& now);
+
+    // adjust all timeouts after a jump of the clock
+    void shift(const timeval& diff);
+
+    int getCount() const { return fEarliest.getCount(); }
+
+private:
+    YTimerHeap fEarliest;
+    YTimerHeap fLatest;
+    unsigned fSerial;
+};
 
 class YSignalPoll: public YPoll<class YApplication> {
 public:
@@ -16,6 +91,26 @@ public:
     virtual bool forWrite();
 };
 
+/*
+ * A timerfd which wakes the main loop at the first timer deadline.
+ */
+class YTimerPoll: public YPoll<class YApplication> {
+public:
+    YTimerPoll(): fArmed(zerotime()) { }
+
+    bool create(YApplication *app);
+    void destroy();
+    bool arm(const timeval *deadline);
+
+    virtual void notifyRead();
+    virtual void notifyWrite();
+    virtual bool forRead();
+    virtual bool forWrite();
+
+private:
+    timeval fArmed;
+};
+
 class IApp {
 public:
     virtual ~IApp();
@@ -61,13 +156,24 @@ public:
     static const upath& getPrivConfDir();
     static upath getHomeDir();
 
+    // how often the main loop woke up in the previous minute
+    int wakeupsPerMinute() const { return fWakeupsPerMinute; }
+
 private:
-    YArray<YTimer*> timers;
-    YArray<YPollBase*> polls;
+    YTimerQueue timers;
+    YPollSet *polls;
 
     YSignalPoll sfd;
     friend class YSignalPoll;
 
+    YTimerPoll tfd;
+    friend class YTimerPoll;
+
+    int fWakeups;
+    int fWakeupsPerMinute;
+    timeval fWakeupMinute;
+    void countWakeup(const timeval& now);
+
     int fLoopLevel;
     int fExitLoop;
     int fExitCode;
@@ -87,7 +193,6 @@ protected:
     virtual void registerTimer(YTimer *t);
     virtual void unregisterTimer(YTimer *t);
     bool nextTimeout(struct timeval *timeout);
-    bool nextTimeoutWithFuzziness(struct timeval *timeout);
     virtual void registerPoll(YPollBase *t);
     virtual void unregisterPoll(YPollBase *t);
 
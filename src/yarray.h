@@ -557,7 +557,8 @@ public:
 };
 
 /*******************************************************************************
- * A fixed multi-dimension array
+ * A fixed multi-dimension array, which is also a ring of rows:
+ * rotate moves the oldest row to the end in constant time.
  ******************************************************************************/
 
 template <class DataType>
@@ -567,12 +568,13 @@ private:
     BaseType* base;
     DataType* data;
     int rows, cols;
+    int first;
 
 public:
     YMulti(int rows, int cols) :
         base(new BaseType[rows]),
         data(new DataType[rows * cols]),
-        rows(rows), cols(cols)
+        rows(rows), cols(cols), first(0)
     {
         for (int i = 0; i < rows; ++i)
             base[i] = data + i * cols;
@@ -583,7 +585,8 @@ public:
     }
 
     BaseType operator[](int index) const {
-        return base[index];
+        index += first;
+        return base[index < rows ? index : index - rows];
     }
 
     void clear() const {
@@ -591,25 +594,34 @@ public:
     }
 
     void clear(int index) const {
-        memset(base[index], 0, sizeof(DataType) * cols);
+        memset((*this)[index], 0, sizeof(DataType) * cols);
+    }
+
+    // Drop the oldest row and append a copy of the newest row.
+    void rotate() {
+        if (rows > 1) {
+            first = (first + 1 < rows) ? first + 1 : 0;
+            copyTo(rows - 2, rows - 1);
+        }
     }
 
     int compare(int left, int right) const {
+        BaseType lp((*this)[left]), rp((*this)[right]);
         int i = -1;
-        while (++i < cols && base[left][i] == base[right][i]);
-        return i < cols ? base[left][i] < base[right][i] ? -1 : +1 : 0;
+        while (++i < cols && lp[i] == rp[i]);
+        return i < cols ? lp[i] < rp[i] ? -1 : +1 : 0;
     }
 
     void copyTo(int from, int dest) const {
-        memcpy(base[dest], base[from], sizeof(DataType) * cols);
+        memcpy((*this)[dest], (*this)[from], sizeof(DataType) * cols);
     }
 
     void copyFrom(int dest, BaseType from) const {
-        memcpy(base[dest], from, sizeof(DataType) * cols);
+        memcpy((*this)[dest], from, sizeof(DataType) * cols);
     }
 
     DataType sum(int row) const {
-        DataType *ptr(base[row]), *end(ptr + cols), total(*ptr);
+        DataType *ptr((*this)[row]), *end(ptr + cols), total(*ptr);
         while (++ptr < end) total += *ptr;
         return total;
     }
@@ -0,0 +1,305 @@
+/*
+ * IceWM - binary cache of parsed configuration files
+ */
+#include "config.h"
+#include "ykey.h"
+#include "yconfig.h"
+#include "yconfcache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*
+ * File layout: a header followed by records.  A record has a fixed
+ * part, the null-terminated path padded to 8 bytes, and for each
+ * assignment the option index, the append flag, the argument length
+ * and the null-terminated argument padded to 4 bytes.  The record is
+ * padded to 8 bytes.  The file uses the native byte order.
+ */
+static const char cacheMagic[8] = { 'I', 'C', 'E', 'C', 'F', 'G', '0', '1' };
+
+// Records of files which are no longer loaded go first.
+static const int recordLimit = 64;
+
+struct YConfigCache::Header {
+    char magic[8];
+    uint32_t recordCount;
+    uint32_t reserved;
+};
+
+struct YConfigCache::Stamp {
+    int64_t sec;
+    int64_t size;
+    int64_t inode;
+    uint32_t nsec;
+    uint32_t reserved;
+
+    bool operator==(const Stamp& s) const {
+        return sec == s.sec && nsec == s.nsec &&
+               size == s.size && inode == s.inode;
+    }
+};
+
+struct YConfigCache::Record {
+    mstring path;
+    unsigned signature;
+    Stamp stamp;
+    YArray<int> options;
+    YArray<bool> appends;
+    YStringArray args;
+};
+
+struct RecordHead {
+    uint32_t length;
+    uint32_t signature;
+    uint32_t pathLength;
+    uint32_t count;
+};
+
+struct Assignment {
+    uint32_t option;
+    uint32_t append;
+    uint32_t argLength;
+};
+
+static unsigned pad4(unsigned n) {
+    return (n + 3) & ~3U;
+}
+
+static unsigned pad8(unsigned n) {
+    return (n + 7) & ~7U;
+}
+
+YConfigCache::YConfigCache(const upath& cacheFile):
+    fCacheFile(cacheFile),
+    fRecording(0),
+    fChanged(false)
+{
+    if (load() == false)
+        fRecords.clear();
+}
+
+YConfigCache::~YConfigCache() {
+    delete fRecording;
+}
+
+// A hash of the option names and types, which changes with the table.
+unsigned YConfigCache::signature(cfoption* options, int* count) {
+    uint32_t hash = 2166136261U;
+    int n = 0;
+    for (; options[n].type != cfoption::CF_NONE; ++n) {
+        for (const char* s = options[n].name; *s; ++s)
+            hash = (hash ^ (unsigned char) *s) * 16777619U;
+        hash = (hash ^ unsigned(options[n].type)) * 16777619U;
+    }
+    *count = n;
+    return hash ^ unsigned(n);
+}
+
+bool YConfigCache::stamp(const upath& path, Stamp* stamp) {
+    struct stat st;
+    if (path.stat(&st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    stamp->sec = st.st_mtime;
+    stamp->size = st.st_size;
+    stamp->inode = int64_t(st.st_ino);
+#if defined(__linux__)
+    stamp->nsec = uint32_t(st.st_mtim.tv_nsec);
+#else
+    stamp->nsec = 0;
+#endif
+    stamp->reserved = 0;
+    return true;
+}
+
+int YConfigCache::find(const upath& path, unsigned signature) const {
+    for (int i = 0; i < fRecords.getCount(); ++i) {
+        if (fRecords[i]->signature == signature &&
+            fRecords[i]->path == path.path())
+            return i;
+    }
+    return -1;
+}
+
+bool YConfigCache::replay(cfoption* options, const upath& path, Setter set) {
+    int count = 0;
+    unsigned sig = signature(options, &count);
+    int i = find(path, sig);
+    Stamp now;
+    if (i < 0 || stamp(path, &now) == false || !(fRecords[i]->stamp == now))
+        return false;
+
+    const Record* r = fRecords[i];
+    for (int k = 0; k < r->options.getCount(); ++k) {
+        if (r->options[k] >= count)
+            return false;
+    }
+    for (int k = 0; k < r->options.getCount(); ++k) {
+        cfoption* o = options + r->options[k];
+        set(o, o->name, r->args[k], r->appends[k]);
+    }
+    return true;
+}
+
+void YConfigCache::begin(cfoption* options, const upath& path) {
+    delete fRecording;
+    fRecording = new Record;
+    int count = 0;
+    fRecording->path = path.path();
+    fRecording->signature = signature(options, &count);
+    if (stamp(path, &fRecording->stamp) == false) {
+        delete fRecording;
+        fRecording = 0;
+    }
+}
+
+void YConfigCache::record(int option, const char* arg, bool append) {
+    if (fRecording) {
+        fRecording->options.append(option);
+        fRecording->appends.append(append);
+        fRecording->args.append(arg);
+    }
+}
+
+void YConfigCache::end(bool loaded) {
+    if (fRecording && loaded) {
+        int i = find(fRecording->path, fRecording->signature);
+        if (i >= 0)
+            fRecords.remove(i);
+        else if (fRecords.getCount() >= recordLimit)
+            fRecords.remove(0);
+        fRecords.append(fRecording);
+        fChanged = true;
+    } else {
+        delete fRecording;
+    }
+    fRecording = 0;
+}
+
+bool YConfigCache::load() {
+    if (fCacheFile.isEmpty())
+        return false;
+
+    int fd = fCacheFile.open(O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(Header))
+        map = mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const char* data = static_cast<const char*>(map);
+    const size_t size = size_t(st.st_size);
+    Header head;
+    memcpy(&head, data, sizeof head);
+    bool valid = (memcmp(head.magic, cacheMagic, sizeof cacheMagic) == 0);
+
+    size_t pos = sizeof(Header);
+    for (unsigned n = 0; valid && n < head.recordCount; ++n) {
+        RecordHead rh;
+        valid = (pos + sizeof rh + sizeof(Stamp) <= size);
+        if (valid) {
+            memcpy(&rh, data + pos, sizeof rh);
+            valid = (rh.length <= size - pos &&
+                     sizeof rh + sizeof(Stamp) + rh.pathLength < rh.length);
+        }
+        if (valid == false)
+            break;
+
+        const size_t last = pos + rh.length;
+        Record* r = new Record;
+        fRecords.append(r);
+        r->signature = rh.signature;
+        memcpy(&r->stamp, data + pos + sizeof rh, sizeof(Stamp));
+        pos += sizeof rh + sizeof(Stamp);
+        r->path = mstring(data + pos, rh.pathLength);
+        pos += pad8(rh.pathLength + 1);
+
+        for (unsigned k = 0; valid && k < rh.count; ++k) {
+            Assignment a;
+            valid = (pos + sizeof a <= last);
+            if (valid) {
+                memcpy(&a, data + pos, sizeof a);
+                pos += sizeof a;
+                valid = (a.argLength < last - pos &&
+                         data[pos + a.argLength] == '\0');
+            }
+            if (valid) {
+                r->options.append(int(a.option));
+                r->appends.append(a.append != 0);
+                r->args.append(data + pos);
+                pos += pad4(a.argLength + 1);
+            }
+        }
+        pos = last;
+    }
+
+    munmap(map, size);
+    return valid;
+}
+
+void YConfigCache::save() {
+    if (fChanged == false || fCacheFile.isEmpty())
+        return;
+    fChanged = false;
+
+    char suffix[32];
+    snprintf(suffix, sizeof suffix, ".%d", int(getpid()));
+    upath temp(fCacheFile.addExtension(suffix));
+    FILE* fp = temp.fopen("w");
+    if (fp == 0)
+        return;
+
+    static const char zeros[8] = { 0, };
+    Header head;
+    memcpy(head.magic, cacheMagic, sizeof cacheMagic);
+    head.recordCount = uint32_t(fRecords.getCount());
+    head.reserved = 0;
+    fwrite(&head, sizeof head, 1, fp);
+
+    for (int i = 0; i < fRecords.getCount(); ++i) {
+        const Record* r = fRecords[i];
+        cstring path(r->path);
+        RecordHead rh;
+        rh.signature = r->signature;
+        rh.pathLength = uint32_t(path.c_str_len());
+        rh.count = uint32_t(r->options.getCount());
+        rh.length = sizeof rh + sizeof(Stamp) + pad8(rh.pathLength + 1);
+        for (int k = 0; k < r->options.getCount(); ++k)
+            rh.length += sizeof(Assignment) + pad4(strlen(r->args[k]) + 1);
+        unsigned written = rh.length;
+        rh.length = pad8(rh.length);
+
+        fwrite(&rh, sizeof rh, 1, fp);
+        fwrite(&r->stamp, sizeof(Stamp), 1, fp);
+        fwrite(path.c_str(), 1, rh.pathLength + 1, fp);
+        fwrite(zeros, 1, pad8(rh.pathLength + 1) - (rh.pathLength + 1), fp);
+        for (int k = 0; k < r->options.getCount(); ++k) {
+            Assignment a;
+            a.option = uint32_t(r->options[k]);
+            a.append = r->appends[k];
+            a.argLength = uint32_t(strlen(r->args[k]));
+            fwrite(&a, sizeof a, 1, fp);
+            fwrite(r->args[k], 1, a.argLength + 1, fp);
+            fwrite(zeros, 1, pad4(a.argLength + 1) - (a.argLength + 1), fp);
+        }
+        fwrite(zeros, 1, rh.length - written, fp);
+    }
+
+    bool written = (ferror(fp) == 0);
+    if (fclose(fp) == 0 && written)
+        written = (temp.renameAs(fCacheFile.path()) == 0);
+    if (written == false)
+        temp.remove();
+}
+
+// vim: set sw=4 ts=4 et:
@@ -0,0 +1,57 @@
+#ifndef YCONFCACHE_H
+#define YCONFCACHE_H
+
+#include "upath.h"
+#include "yarray.h"
+
+struct cfoption;
+
+/*
+ * The option assignments which configuration files made, stored in
+ * a binary file which is mapped into memory on startup.  A record is
+ * keyed by the path of a configuration file, its size, inode and
+ * modification time, and a signature of the option table.  When a
+ * file has not changed, its assignments are replayed from the record
+ * instead of parsing the text again.
+ */
+class YConfigCache {
+public:
+    typedef bool (*Setter)(cfoption* option, const char* name,
+                           const char* arg, bool append);
+
+    explicit YConfigCache(const upath& cacheFile);
+    ~YConfigCache();
+
+    // Apply the recorded assignments if the file is unchanged.
+    bool replay(cfoption* options, const upath& path, Setter set);
+
+    // Record the assignments of a file while it is parsed.
+    void begin(cfoption* options, const upath& path);
+    void record(int option, const char* arg, bool append);
+    void end(bool loaded);
+
+    void save();
+
+private:
+    YConfigCache(const YConfigCache&);
+    YConfigCache& operator=(const YConfigCache&);
+
+    struct Header;
+    struct Stamp;
+    struct Record;
+
+    static unsigned signature(cfoption* options, int* count);
+    static bool stamp(const upath& path, Stamp* stamp);
+
+    int find(const upath& path, unsigned signature) const;
+    bool load();
+
+    const upath fCacheFile;
+    YObjectArray<Record> fRecords;
+    Record* fRecording;
+    bool fChanged;
+};
+
+#endif
+
+// vim: set sw=4 ts=4 et:
@@ -12,6 +12,8 @@
 #include "intl.h"
 #include "ascii.h"
 #include "argument.h"
+#include "ytimer.h"
+#include "yconfcache.h"
 
 upath findPath(ustring path, int mode, upath name) {
     if (name.isAbsolute()) { // check for root in XFreeOS/2
@@ -132,95 +134,153 @@ bool YConfig::parseKey(const char *arg, KeySym *key, unsigned int *mod) {
 }
 
 
-static char *setOption(cfoption *options, char *name, const char *arg, bool append, char *rest) {
-    unsigned int a;
-
-    MSG(("SET %s := %s ;", name, arg));
-
-    for (a = 0; options[a].type != cfoption::CF_NONE; a++) {
-        if (strcmp(name, options[a].name) != 0)
-            continue;
-
-        switch (options[a].type) {
-        case cfoption::CF_BOOL:
-            if (options[a].v.b.bool_value) {
-                if ((arg[0] == '1' || arg[0] == '0') && arg[1] == 0) {
-                    *(options[a].v.b.bool_value) = (arg[0] == '1');
-                } else {
-                    msg(_("Bad argument: %s for %s [%d,%d]"), arg, name, 0, 1);
-                    return rest;
-                }
-                return rest;
-            }
-            break;
-        case cfoption::CF_INT:
-            if (options[a].v.i.int_value) {
-                int const v(atoi(arg));
-
-                if (v >= options[a].v.i.min && v <= options[a].v.i.max)
-                    *(options[a].v.i.int_value) = v;
-                else {
-                    msg(_("Bad argument: %s for %s [%d,%d]"), arg, name,
-                            options[a].v.i.min, options[a].v.i.max);
-                    return rest;
-                }
-                return rest;
+// Assign an argument to one option, unless it has no value.
+static bool setOption(cfoption *option, const char *name, const char *arg,
+                      bool append)
+{
+    switch (option->type) {
+    case cfoption::CF_BOOL:
+        if (option->v.b.bool_value) {
+            if ((arg[0] == '1' || arg[0] == '0') && arg[1] == 0) {
+                *(option->v.b.bool_value) = (arg[0] == '1');
+            } else {
+                msg(_("Bad argument: %s for %s [%d,%d]"), arg, name, 0, 1);
             }
-            break;
-        case cfoption::CF_UINT:
-            if (options[a].v.u.uint_value) {
-                unsigned const v(strtoul(arg, NULL, 0));
-
-                if (v >= options[a].v.u.min && v <= options[a].v.u.max)
-                    *(options[a].v.u.uint_value) = v;
-                else {
-                    msg(_("Bad argument: %s for %s [%d,%d]"), arg, name,
-                            int(options[a].v.u.min), int(options[a].v.u.max));
-                    return rest;
-                }
-                return rest;
+            return true;
+        }
+        break;
+    case cfoption::CF_INT:
+        if (option->v.i.int_value) {
+            int const v(atoi(arg));
+
+            if (v >= option->v.i.min && v <= option->v.i.max)
+                *(option->v.i.int_value) = v;
+            else {
+                msg(_("Bad argument: %s for %s [%d,%d]"), arg, name,
+                        option->v.i.min, option->v.i.max);
             }
-            break;
-        case cfoption::CF_STR:
-            if (options[a].v.s.string_value) {
-                if (!options[a].v.s.initial)
-                    delete[] (char *)*options[a].v.s.string_value;
-                *options[a].v.s.string_value = newstr(arg);
-                options[a].v.s.initial = false;
-                return rest;
+            return true;
+        }
+        break;
+    case cfoption::CF_UINT:
+        if (option->v.u.uint_value) {
+            unsigned const v(strtoul(arg, NULL, 0));
+
+            if (v >= option->v.u.min && v <= option->v.u.max)
+                *(option->v.u.uint_value) = v;
+            else {
+                msg(_("Bad argument: %s for %s [%d,%d]"), arg, name,
+                        int(option->v.u.min), int(option->v.u.max));
             }
-            break;
-        case cfoption::CF_KEY:
-            if (options[a].v.k.key_value) {
-                WMKey *wk = options[a].v.k.key_value;
-
-                if (YConfig::parseKey(arg, &wk->key, &wk->mod)) {
-                    if (!wk->initial)
-                        delete[] (char *)wk->name;
-                    wk->name = newstr(arg);
-                    wk->initial = false;
-                }
-                return rest;
+            return true;
+        }
+        break;
+    case cfoption::CF_STR:
+        if (option->v.s.string_value) {
+            if (!option->v.s.initial)
+                delete[] (char *)*option->v.s.string_value;
+            *option->v.s.string_value = newstr(arg);
+            option->v.s.initial = false;
+            return true;
+        }
+        break;
+    case cfoption::CF_KEY:
+        if (option->v.k.key_value) {
+            WMKey *wk = option->v.k.key_value;
+
+            if (YConfig::parseKey(arg, &wk->key, &wk->mod)) {
+                if (!wk->initial)
+                    delete[] (char *)wk->name;
+                wk->name = newstr(arg);
+                wk->initial = false;
             }
-            break;
-        case cfoption::CF_FUNC:
-            options[a].fun()(name, arg, append);
-            return rest;
-        case cfoption::CF_NONE:
-            break;
+            return true;
+        }
+        break;
+    case cfoption::CF_FUNC:
+        option->fun()(name, arg, append);
+        return true;
+    case cfoption::CF_NONE:
+        break;
+    }
+    return false;
+}
+
+/*
+ * The options of a table sorted by name, so that each option line
+ * is found by a binary search.  When a name occurs more than once,
+ * the first option with a value wins, like in a linear search.
+ */
+class OptionIndex {
+public:
+    OptionIndex(cfoption *options, YConfigCache *cache = 0);
+    ~OptionIndex() { delete[] fSorted; }
+
+    bool set(const char *name, const char *arg, bool append) const;
+
+    int lines() const { return fLines; }
+    int matches() const { return fMatches; }
+
+private:
+    static int compare(const void *p1, const void *p2);
+
+    cfoption *fOptions;
+    YConfigCache *fCache;
+    cfoption **fSorted;
+    int fCount;
+    mutable int fLines;
+    mutable int fMatches;
+};
+
+OptionIndex::OptionIndex(cfoption *options, YConfigCache *cache):
+    fOptions(options), fCache(cache),
+    fSorted(0), fCount(0), fLines(0), fMatches(0)
+{
+    while (options[fCount].type != cfoption::CF_NONE)
+        ++fCount;
+    fSorted = new cfoption *[fCount + 1];
+    for (int i = 0; i < fCount; ++i)
+        fSorted[i] = options + i;
+    qsort(fSorted, fCount, sizeof(cfoption *), compare);
+}
+
+int OptionIndex::compare(const void *p1, const void *p2) {
+    const cfoption *o1 = *(const cfoption *const *) p1;
+    const cfoption *o2 = *(const cfoption *const *) p2;
+    int c = strcmp(o1->name, o2->name);
+    return c ? c : o1 < o2 ? -1 : o1 > o2;
+}
+
+bool OptionIndex::set(const char *name, const char *arg, bool append) const {
+    MSG(("SET %s := %s ;", name, arg));
+    ++fLines;
+
+    int lo = 0, hi = fCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(fSorted[mid]->name, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < fCount && strcmp(fSorted[lo]->name, name) == 0; ++lo) {
+        if (setOption(fSorted[lo], name, arg, append)) {
+            if (fCache)
+                fCache->record(int(fSorted[lo] - fOptions), arg, append);
+            ++fMatches;
+            return true;
         }
     }
 #if 0
     msg(_("Bad option: %s"), name);
 #endif
-    ///!!! check
-    return rest;
+    return false;
 }
 
 // Parse one option name at 'str' and its argument(s).
 // The name is a string without spaces up to '='.
 // Option is a quoted string or characters up to next space.
-static char *parseOption(cfoption *options, char *str) {
+static char *parseOption(const OptionIndex& index, char *str) {
     char name[64];
     char *p = str;
     size_t len = 0;
@@ -253,9 +313,7 @@ static char *parseOption(cfoption *options, char *str) {
         if (p == 0)
             break;
 
-        p = setOption(options, name, argument, append, p);
-        if (p == 0)
-            return 0;
+        index.set(name, argument, append);
 
         while (ASCII::isSpaceOrTab(*p))
             p++;
@@ -265,6 +323,11 @@ static char *parseOption(cfoption *options, char *str) {
 }
 
 void YConfig::parseConfiguration(cfoption *options, char *data) {
+    OptionIndex index(options);
+    parseConfiguration(index, data);
+}
+
+void YConfig::parseConfiguration(const OptionIndex& index, char *data) {
     for (char *p = data; p && *p; ) {
         while (ASCII::isWhiteSpace(*p) || ASCII::isEscapedLineEnding(p))
             p++;
@@ -274,19 +337,85 @@ void YConfig::parseConfiguration(cfoption *options, char *data) {
                 if (*p == '\\' && p[1])
                     p++;
         } else if (*p)
-            p = parseOption(options, p);
+            p = parseOption(index, p);
     }
 }
 
+// How long it took to load the most recent configuration files.
+struct ConfigTiming {
+    upath path;
+    long micros;
+    int lines;
+    int matches;
+    bool cached;
+};
+
+static ConfigTiming timings[16];
+static int timingCount;
+static YConfigCache *configCache;
+
+static void addTiming(upath path, timeval start, int lines, int matches,
+                      bool cached)
+{
+    timeval delta = monotime() - start;
+    ConfigTiming& t = timings[timingCount++ % int ACOUNT(timings)];
+    t.path = path;
+    t.micros = delta.tv_sec * 1000000L + delta.tv_usec;
+    t.lines = lines;
+    t.matches = matches;
+    t.cached = cached;
+    MSG(("loaded %s: %d options in %ld us%s", path.string().c_str(),
+         lines, t.micros, cached ? " from cache" : ""));
+}
+
 bool YConfig::loadConfigFile(cfoption *options, upath fileName) {
+    timeval start = monotime();
+    if (configCache && configCache->replay(options, fileName, setOption)) {
+        addTiming(fileName, start, 0, 0, true);
+        return true;
+    }
+
+    if (configCache)
+        configCache->begin(options, fileName);
     char* buf = fileName.loadText();
     if (buf) {
-        parseConfiguration(options, buf);
+        OptionIndex index(options, configCache);
+        parseConfiguration(index, buf);
         delete[] buf;
+        addTiming(fileName, start, index.lines(), index.matches(), false);
     }
+    if (configCache)
+        configCache->end(buf != 0);
     return buf != 0;
 }
 
+void YConfig::openCache(upath cacheFile) {
+    if (configCache == 0)
+        configCache = new YConfigCache(cacheFile);
+}
+
+void YConfig::closeCache() {
+    if (configCache) {
+        configCache->save();
+        delete configCache;
+        configCache = 0;
+    }
+}
+
+void YConfig::statistics() {
+    const int count = min(timingCount, int ACOUNT(timings));
+    for (int i = timingCount - count; i < timingCount; ++i) {
+        const ConfigTiming& t = timings[i % int ACOUNT(timings)];
+        if (t.cached)
+            tlog("config: %s: cached in %ld.%03ld ms",
+                 t.path.string().c_str(), t.micros / 1000, t.micros % 1000);
+        else
+            tlog("config: %s: %d of %d options in %ld.%03ld ms",
+                 t.path.string().c_str(), t.matches, t.lines,
+                 t.micros / 1000, t.micros % 1000);
+    }
+}
+
 void YConfig::freeConfig(cfoption *options) {
     for (cfoption* o = options; o->type != cfoption::CF_NONE; ++o) {
         if (o->type == cfoption::CF_STR &&
@@ -140,6 +140,7 @@ struct cfoption {
 
 class Argument;
 class IApp;
+class OptionIndex;
 class upath;
 
 class YConfig {
@@ -152,6 +153,14 @@ public:
     static void parseConfiguration(cfoption *options, char *data);
     static bool parseKey(const char *arg, KeySym *key, unsigned int *mod);
     static size_t cfoptionSize();
+    static void statistics();
+
+    // Replay unchanged configuration files from a binary cache.
+    static void openCache(upath cacheFile);
+    static void closeCache();
+
+private:
+    static void parseConfiguration(const OptionIndex& index, char *data);
 };
 
 #endif
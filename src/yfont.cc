@@ -10,6 +10,7 @@
 extern ref<YFont> getXftFont(ustring name, bool antialias);
 extern ref<YFont> getXftFontXlfd(ustring name, bool antialias);
 extern ref<YFont> getCoreFont(const char*);
+extern void xftFontStatistics();
 
 ref<YFont> YFont::getFont(ustring name, ustring xftFont, bool antialias) {
 #if defined(CONFIG_XFREETYPE) && defined(CONFIG_COREFONTS)
@@ -34,6 +35,12 @@ ref<YFont> YFont::getFont(ustring name, ustring xftFont, bool antialias) {
 #endif
 }
 
+void YFont::statistics() {
+#ifdef CONFIG_XFREETYPE
+    xftFontStatistics();
+#endif
+}
+
 int YFont::textWidth(char const * str) const {
     return textWidth(str, strlen(str));
 }
@@ -8,6 +8,7 @@
 #include "yxapp.h"
 #include "intl.h"
 #include <stdio.h>
+#include <string.h>
 #include <ft2build.h>
 #include <X11/Xft/Xft.h>
 
@@ -47,6 +48,8 @@ public:
     virtual void drawGlyphs(class Graphics & graphics, int x, int y,
                             char const * str, int len);
 
+    static void statistics();
+
 private:
     struct TextPart {
         XftFont * font;
@@ -54,10 +57,49 @@ private:
         unsigned width;
     };
 
-    TextPart * partitions(char_t * str, size_t len, size_t nparts = 0) const;
+    // The converted text, partitions and width of a measured string.
+    struct Layout {
+        Layout * older;
+        Layout * newer;
+        Layout * chain;
+        unsigned long hash;
+        char * key;
+        int keyLength;
+        char_t * text;
+        size_t length;
+        TextPart * parts;
+        unsigned width;
+    };
+
+    enum {
+        CoverageSlots = 1024,   // direct mapped by code point
+        LayoutBuckets = 128,
+        LayoutLimit = 128,      // layouts kept per font
+        LayoutKeyLimit = 512,   // longer strings are not kept
+    };
+
+    TextPart * partitions(char_t * str, size_t len) const;
+    unsigned coverage(char_t c) const;
+    Layout * layout(char const * str, int len) const;
+    void forget(Layout * l) const;
+    static void release(Layout * l);
 
     unsigned fFontCount, fAscent, fDescent;
     XftFont ** fFonts;
+
+    // Which font has the glyph for a code point, or fFontCount for none.
+    mutable char_t fCoverCode[CoverageSlots];
+    mutable unsigned short fCoverFont[CoverageSlots];
+
+    // Recently used layouts in hash chains and in least recently used
+    // order, from fRecent.newer (oldest) to fRecent.older (newest).
+    mutable Layout * fBuckets[LayoutBuckets];
+    mutable Layout fRecent;
+    mutable int fLayoutCount;
+    mutable Layout * fScratch;
+
+    static unsigned long fCoverageHits, fCoverageMisses;
+    static unsigned long fLayoutHits, fLayoutMisses;
 };
 
 class XftGraphics {
@@ -116,9 +158,18 @@ public:
 
 /******************************************************************************/
 
+unsigned long YXftFont::fCoverageHits;
+unsigned long YXftFont::fCoverageMisses;
+unsigned long YXftFont::fLayoutHits;
+unsigned long YXftFont::fLayoutMisses;
+
 YXftFont::YXftFont(ustring name, bool use_xlfd, bool /*antialias*/):
-    fFontCount(0), fAscent(0), fDescent(0)
+    fFontCount(0), fAscent(0), fDescent(0),
+    fLayoutCount(0), fScratch(0)
 {
+    memset(fCoverFont, 0, sizeof fCoverFont);
+    memset(fBuckets, 0, sizeof fBuckets);
+    fRecent.older = fRecent.newer = &fRecent;
     fFontCount = 0;
     ustring s(null), r(null);
 
@@ -183,6 +234,10 @@ YXftFont::YXftFont(ustring name, bool use_xlfd, bool /*antialias*/):
 }
 
 YXftFont::~YXftFont() {
+    while (fRecent.newer != &fRecent)
+        forget(fRecent.newer);
+    release(fScratch);
+
     for (unsigned n = 0; n < fFontCount; ++n) {
         // this leaks memory when xapp is destroyed before fonts
         if (xapp != 0)
@@ -210,21 +265,19 @@ int YXftFont::textWidth(string_t const & text) const {
 }
 
 int YXftFont::textWidth(char const * str, int len) const {
-    return textWidth(string_t(str, len));
+    return layout(str, len)->width;
 }
 
 void YXftFont::drawGlyphs(Graphics & graphics, int x, int y,
                           char const * str, int len) {
-    string_t xtext(str, len);
-    if (0 == xtext.length()) return;
+    Layout * text = layout(str, len);
+    if (0 == text->length) return;
 
     int const y0(y - ascent());
     int const gcFn(graphics.function());
 
-    char_t * xstr((char_t *) xtext.data());
-    size_t xlen(xtext.length());
-
-    TextPart *parts = partitions(xstr, xlen);
+    char_t * xstr(text->text);
+    TextPart *parts = text->parts;
 ///    unsigned w(0);
 ///    unsigned const h(height());
 
@@ -258,63 +311,160 @@ void YXftFont::drawGlyphs(Graphics & graphics, int x, int y,
         xpos += p->width;
     }
 
-    delete[] parts;
-
 ///    graphics.copyDrawable(canvas.drawable(), 0, 0, w, h, x, y0);
 ///    delete pixmap;
 }
 
-YXftFont::TextPart * YXftFont::partitions(char_t * str, size_t len,
-                                          size_t nparts) const
+unsigned YXftFont::coverage(char_t c) const {
+    unsigned slot = unsigned(c) % CoverageSlots;
+    if (fCoverFont[slot] && fCoverCode[slot] == c) {
+        ++fCoverageHits;
+        return fCoverFont[slot] - 1U;
+    }
+    ++fCoverageMisses;
+
+    unsigned k = 0;
+    while (k < fFontCount && !XftGlyphExists(xapp->display(), fFonts[k], c))
+        ++k;
+    if (k == fFontCount) {
+        MSG(("glyph not found: %d", c));
+    }
+
+    if (fFontCount < 0xFFFF) {
+        fCoverCode[slot] = c;
+        fCoverFont[slot] = (unsigned short) (k + 1);
+    }
+    return k;
+}
+
+YXftFont::TextPart * YXftFont::partitions(char_t * str, size_t len) const
 {
+    size_t nparts = 0;
+    for (size_t i = 0; i < len; ++nparts) {
+        unsigned font = coverage(str[i]);
+        while (++i < len && coverage(str[i]) == font);
+    }
+
+    TextPart *parts = new TextPart[nparts + 1];
+    parts[nparts].font = NULL;
+    parts[nparts].width = 0;
+    parts[nparts].length = 0;
+
     XGlyphInfo extends;
-    XftFont ** lFont(fFonts + fFontCount);
-    XftFont ** font(NULL);
-    char_t * c(str);
-
-    for (char_t * endptr(str + len); c < endptr; ++c) {
-        XftFont ** probe(fFonts);
-
-        while (probe < lFont && !XftGlyphExists(xapp->display(), *probe, *c))
-            ++probe;
-
-        if (probe != font) {
-            if (NULL != font) {
-                TextPart *parts = partitions(c, len - (c - str), nparts + 1);
-                parts[nparts].length = (c - str);
-
-                if (font < lFont) {
-                    XftGraphics::textExtents(*font, str, (c - str), extends);
-                    parts[nparts].font = *font;
-                    parts[nparts].width = extends.xOff;
-                } else {
-                    parts[nparts].font = NULL;
-                    parts[nparts].width = 0;
-                    MSG(("glyph not found: %d", *(c - 1)));
-                }
-
-                return parts;
-            } else
-                font = probe;
+    TextPart *p = parts;
+    for (size_t i = 0; i < len; ++p) {
+        size_t start = i;
+        unsigned font = coverage(str[i]);
+        while (++i < len && coverage(str[i]) == font);
+
+        p->length = i - start;
+        if (font < fFontCount) {
+            XftGraphics::textExtents(fFonts[font], str + start,
+                                     p->length, extends);
+            p->font = fFonts[font];
+            p->width = extends.xOff;
+        } else {
+            p->font = NULL;
+            p->width = 0;
         }
     }
 
-    TextPart *parts = new TextPart[nparts + 2];
-    parts[nparts + 1].font =  NULL;
-    parts[nparts + 1].width = 0;
-    parts[nparts + 1].length = 0;
-    parts[nparts].length = (c - str);
-
-    if (NULL != font && font < lFont) {
-        XftGraphics::textExtents(*font, str, (c - str), extends);
-        parts[nparts].font = *font;
-        parts[nparts].width = extends.xOff;
-    } else {
-        parts[nparts].font = NULL;
-        parts[nparts].width = 0;
+    return parts;
+}
+
+// Find or create the layout of a string, which remains valid
+// until the next call.
+YXftFont::Layout * YXftFont::layout(char const * str, int len) const {
+    if (len < 0)
+        len = 0;
+
+    unsigned long hash = 2166136261UL;
+    for (int i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char) str[i]) * 16777619UL;
+
+    Layout ** bucket = fBuckets + hash % LayoutBuckets;
+    for (Layout * l = *bucket; l; l = l->chain) {
+        if (l->hash == hash && l->keyLength == len &&
+            0 == memcmp(l->key, str, len))
+        {
+            ++fLayoutHits;
+            l->older->newer = l->newer;
+            l->newer->older = l->older;
+            l->older = fRecent.older;
+            l->newer = &fRecent;
+            fRecent.older->newer = l;
+            fRecent.older = l;
+            return l;
+        }
     }
+    ++fLayoutMisses;
 
-    return parts;
+    string_t xtext(str, len);
+    Layout * l = new Layout;
+    l->hash = hash;
+    l->keyLength = len;
+    l->key = new char[len + 1];
+    memcpy(l->key, str, len);
+    l->length = xtext.length();
+    l->text = new char_t[l->length + 1];
+    memcpy(l->text, xtext.data(), l->length * sizeof(char_t));
+    l->parts = partitions(l->text, l->length);
+    l->width = 0;
+    for (TextPart * p = l->parts; p->length; ++p)
+        l->width += p->width;
+
+    if (len > LayoutKeyLimit) {
+        release(fScratch);
+        fScratch = l;
+        return l;
+    }
+
+    if (fLayoutCount >= LayoutLimit)
+        forget(fRecent.newer);
+
+    l->chain = *bucket;
+    *bucket = l;
+    l->older = fRecent.older;
+    l->newer = &fRecent;
+    fRecent.older->newer = l;
+    fRecent.older = l;
+    ++fLayoutCount;
+    return l;
+}
+
+void YXftFont::forget(Layout * l) const {
+    Layout ** link = fBuckets + l->hash % LayoutBuckets;
+    while (*link != l)
+        link = &(*link)->chain;
+    *link = l->chain;
+    l->older->newer = l->newer;
+    l->newer->older = l->older;
+    --fLayoutCount;
+    release(l);
+}
+
+void YXftFont::release(Layout * l) {
+    if (l) {
+        delete[] l->key;
+        delete[] l->text;
+        delete[] l->parts;
+        delete l;
+    }
+}
+
+void YXftFont::statistics() {
+    unsigned long lookups = fLayoutHits + fLayoutMisses;
+    unsigned long probes = fCoverageHits + fCoverageMisses;
+    if (lookups) {
+        tlog("xft: %lu text layouts, %.1f%% cached"
+             ", %lu glyph lookups, %.1f%% cached",
+             lookups, 100.0 * fLayoutHits / lookups,
+             probes, probes ? 100.0 * fCoverageHits / probes : 0.0);
+    }
+}
+
+void xftFontStatistics() {
+    YXftFont::statistics();
 }
 
 ref<YFont> getXftFontXlfd(ustring name, bool antialias) {
@@ -12,14 +12,38 @@
 #include "prefs.h"
 #include "yprefs.h"
 #include "ypaths.h"
+#include "yiconindex.h"
+#include "ypoll.h"
+#include "yxapp.h"
+#include "yxcontext.h"
 #ifdef HAVE_WORDEXP
 #include <wordexp.h>
 #endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "intl.h"
 
 static ref<YResourcePaths> iconPaths;
 static MStringArray iconDirs;
+static YIconIndex* iconIndex;
+
+static void initIconIndex() {
+    MStringArray roots;
+    for (MStringArray::IterType iter = iconDirs.iterator(); ++iter; ) {
+        roots.append(*iter);
+    }
+    for (YResourcePaths::IterType iter = iconPaths->iterator(); ++iter; ) {
+        roots.append(iter->relative("icons").path());
+    }
+    const unsigned sizes[] = {
+        YIcon::menuSize(), YIcon::smallSize(),
+        YIcon::largeSize(), YIcon::hugeSize(),
+    };
+    iconIndex = new YIconIndex(roots, sizes, int ACOUNT(sizes),
+                               YApplication::getPrivConfDir() + "/iconindex");
+}
 
 static void initIconPaths() {
     if (iconPaths == null) {
@@ -58,21 +82,448 @@ static void initIconPaths() {
             }
         }
     }
+    if (iconIndex == 0) {
+        initIconIndex();
+    }
+}
+
+/*
+ * Icons by name in an open-addressing hash table.  Their decoded
+ * images are kept per size in least-recently-used order and
+ * released when they exceed IconCacheSize kilobytes.  An icon
+ * which lost all its images and is no longer referenced elsewhere
+ * leaves the table, so the cache stays bounded in long sessions.
+ */
+class YIconCache {
+public:
+    YIconCache();
+    ~YIconCache() { clear(); }
+
+    ref<YIcon> find(const char* name);
+    void insert(ref<YIcon> icon);
+    void touch(YIcon::Usage* usage, ref<YImage> image);
+    void clear();
+    void statistics();
+
+private:
+    struct Slot {
+        unsigned long hash;
+        ref<YIcon> icon;
+    };
+    Slot* slots;
+    int capacity;
+    int count;
+
+    YIcon::Usage recent;
+    unsigned long bytes;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+
+    int next(int k) const { return (k + 1) & (capacity - 1); }
+    int lookup(unsigned long hash, const char* name) const;
+    void remove(YIcon* icon);
+    void resize(int size);
+    void unlink(YIcon::Usage* usage);
+    void evict(YIcon::Usage* keep);
+    unsigned long budget() const;
+};
+
+static YIconCache iconCache;
+
+YIconCache::YIconCache():
+    slots(0), capacity(0), count(0),
+    bytes(0), hits(0), misses(0), evictions(0)
+{
+    recent.older = recent.newer = &recent;
+    recent.icon = 0;
+    recent.bytes = 0;
+}
+
+int YIconCache::lookup(unsigned long hash, const char* name) const {
+    if (capacity) {
+        for (int k = int(hash & (capacity - 1)); slots[k].icon != null;
+             k = next(k))
+        {
+            if (slots[k].hash == hash && slots[k].icon->fPath.path() == name)
+                return k;
+        }
+    }
+    return -1;
+}
+
+ref<YIcon> YIconCache::find(const char* name) {
+    int k = lookup(strhash(name), name);
+    return k < 0 ? null : slots[k].icon;
+}
+
+void YIconCache::insert(ref<YIcon> icon) {
+    if (2 * (count + 1) > capacity)
+        resize(capacity ? 2 * capacity : 64);
+
+    cstring name(icon->fPath.path());
+    unsigned long hash = strhash(name);
+    int k = int(hash & (capacity - 1));
+    while (slots[k].icon != null)
+        k = next(k);
+    slots[k].hash = hash;
+    slots[k].icon = icon;
+    ++count;
+}
+
+void YIconCache::remove(YIcon* icon) {
+    cstring name(icon->fPath.path());
+    int k = lookup(strhash(name), name);
+    if (k < 0)
+        return;
+
+    // Shift back later members of the probe sequence into the hole.
+    for (int i = next(k); slots[i].icon != null; i = next(i)) {
+        int home = int(slots[i].hash & (capacity - 1));
+        if (((i - home) & (capacity - 1)) >= ((i - k) & (capacity - 1))) {
+            slots[k].hash = slots[i].hash;
+            slots[k].icon = slots[i].icon;
+            k = i;
+        }
+    }
+    slots[k].icon = null;
+    --count;
+}
+
+void YIconCache::resize(int size) {
+    Slot* old = slots;
+    int oldCapacity = capacity;
+
+    slots = new Slot[size];
+    capacity = size;
+    count = 0;
+    for (int i = 0; i < oldCapacity; ++i) {
+        if (old[i].icon != null) {
+            int k = int(old[i].hash & (capacity - 1));
+            while (slots[k].icon != null)
+                k = next(k);
+            slots[k].hash = old[i].hash;
+            slots[k].icon = old[i].icon;
+            ++count;
+        }
+    }
+    delete[] old;
+}
+
+unsigned long YIconCache::budget() const {
+    return iconCacheSize > 0 ? 1024UL * iconCacheSize : 0UL;
 }
 
+void YIconCache::unlink(YIcon::Usage* usage) {
+    usage->older->newer = usage->newer;
+    usage->newer->older = usage->older;
+    usage->older = usage->newer = 0;
+    bytes -= usage->bytes;
+    usage->bytes = 0;
+}
+
+void YIconCache::touch(YIcon::Usage* usage, ref<YImage> image) {
+    if (usage->newer) {
+        ++hits;
+        usage->older->newer = usage->newer;
+        usage->newer->older = usage->older;
+    } else {
+        ++misses;
+    }
+    usage->older = &recent;
+    usage->newer = recent.newer;
+    recent.newer->older = usage;
+    recent.newer = usage;
+
+    unsigned long size = sizeof(YIcon);
+    if (image != null)
+        size += 4UL * image->width() * image->height();
+    bytes = bytes - usage->bytes + size;
+    usage->bytes = size;
+
+    if (budget() && bytes > budget())
+        evict(usage);
+}
+
+void YIconCache::evict(YIcon::Usage* keep) {
+    while (bytes > budget() && recent.older != keep) {
+        YIcon::Usage* usage = recent.older;
+        YIcon* icon = usage->icon;
+
+        unlink(usage);
+        icon->release(int(usage - icon->fUsage));
+        ++evictions;
+
+        bool idle = (icon != keep->icon && icon->__refcount == 1);
+        for (int i = 0; idle && i < YIcon::Sizes; ++i)
+            idle = (icon->fUsage[i].newer == 0);
+        if (idle)
+            remove(icon);
+    }
+}
+
+void YIconCache::clear() {
+    while (recent.older != &recent)
+        unlink(recent.older);
+    for (int i = 0; i < capacity; ++i) {
+        ref<YIcon> icon = slots[i].icon;
+        if (icon != null) {
+            slots[i].icon = null;
+            icon->fCached = false;
+            icon->fPath = null;
+            icon->fSmall = null;
+            icon->fLarge = null;
+            icon->fHuge = null;
+        }
+    }
+    delete[] slots;
+    slots = 0;
+    capacity = count = 0;
+}
+
+void YIconCache::statistics() {
+    tlog("icons: %d cached, %lu of %lu KB, "
+         "%lu hits, %lu misses, %lu evictions",
+         count, bytes / 1024, budget() / 1024, hits, misses, evictions);
+}
+
+/*
+ * Decodes and scales icon files on worker threads, so that a menu
+ * with many new icons pops up at once.  Only the Xlib loaders for
+ * PNG and JPEG files are used off the X thread, because they do not
+ * talk to the server; other files are still loaded when drawn.
+ * Decoded images come back through a pipe which the main loop polls.
+ * Windows which drew an icon that was not ready are repainted then.
+ */
+#if defined(CONFIG_XPM) && !defined(CONFIG_GDK_PIXBUF_XLIB)
+#define CONFIG_ICON_LOADER
+#endif
+
+class YIconLoader: public YPollBase {
+public:
+    YIconLoader();
+    ~YIconLoader();
+
+    bool request(YIcon* icon, int size, YWindow* window);
+    void statistics();
+
+    virtual void notifyRead();
+    virtual void notifyWrite() { }
+    virtual bool forRead() { return true; }
+    virtual bool forWrite() { return false; }
+
+private:
+    struct Job {
+        ref<YIcon> icon;
+        int size;
+        unsigned pixels;
+        char* path;
+        ref<YImage> image;
+    };
+    YArray<Job*> fQueue;        // guarded by fMutex
+    YArray<Job*> fDone;         // guarded by fMutex
+    YArray<Window> fWaiting;
+    pthread_mutex_t fMutex;
+    pthread_cond_t fWork;
+    pthread_t* fThreads;
+    int fThreadCount;
+    int fPipe[2];
+    bool fStop;
+
+    unsigned long fDecoded;
+    unsigned long fFailed;
+    unsigned long fRepaints;
+
+    bool start();
+    void work();
+    static void* worker(void* self) {
+        static_cast<YIconLoader*>(self)->work();
+        return 0;
+    }
+};
+
+static YIconLoader* iconLoader;
+
+YIconLoader::YIconLoader():
+    fThreads(0),
+    fThreadCount(0),
+    fStop(false),
+    fDecoded(0),
+    fFailed(0),
+    fRepaints(0)
+{
+    fPipe[0] = fPipe[1] = -1;
+    pthread_mutex_init(&fMutex, 0);
+    pthread_cond_init(&fWork, 0);
+}
+
+YIconLoader::~YIconLoader() {
+    pthread_mutex_lock(&fMutex);
+    fStop = true;
+    pthread_cond_broadcast(&fWork);
+    pthread_mutex_unlock(&fMutex);
+    for (int i = 0; i < fThreadCount; ++i)
+        pthread_join(fThreads[i], 0);
+    delete[] fThreads;
+
+    for (int i = 0; i < fDone.getCount(); ++i)
+        fQueue.append(fDone[i]);
+    for (int i = 0; i < fQueue.getCount(); ++i) {
+        fQueue[i]->icon->fLoading = 0;
+        delete[] fQueue[i]->path;
+        delete fQueue[i];
+    }
+    unregisterPoll();
+    for (int i = 0; i < 2; ++i)
+        if (fPipe[i] >= 0)
+            close(fPipe[i]);
+    pthread_cond_destroy(&fWork);
+    pthread_mutex_destroy(&fMutex);
+}
+
+bool YIconLoader::start() {
+    if (fPipe[0] >= 0)
+        return fThreadCount > 0;
+    if (pipe(fPipe) != 0) {
+        fPipe[0] = fPipe[1] = -1;
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(fPipe[i], F_SETFL, O_NONBLOCK);
+        fcntl(fPipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    registerPoll(fPipe[0]);
+
+    // Lazily created visuals must exist before the workers need them.
+    xapp->visualForDepth(32);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = int(max(1L, min(cpus, 4L)));
+    fThreads = new pthread_t[count];
+    for (; fThreadCount < count; ++fThreadCount) {
+        if (pthread_create(&fThreads[fThreadCount], 0, worker, this))
+            break;
+    }
+    return fThreadCount > 0;
+}
+
+bool YIconLoader::request(YIcon* icon, int size, YWindow* window) {
+    if ((icon->fLoading & (1 << size)) == 0) {
+        static unsigned (*const sizes[])() = {
+            YIcon::smallSize, YIcon::largeSize, YIcon::hugeSize,
+        };
+        const unsigned pixels = sizes[size]();
+        upath file(icon->iconFile(pixels));
+        if (file == null)
+            return false;
+        pstring ext(file.getExtension().lower());
+        if (ext != ".png" && ext != ".jpg" && ext != ".jpeg")
+            return false;
+        if (start() == false)
+            return false;
+
+        Job* job = new Job;
+        job->icon = ref<YIcon>(icon);
+        job->size = size;
+        job->pixels = pixels;
+        job->path = newstr(cstring(file.path()));
+        icon->fLoading |= (1 << size);
+
+        pthread_mutex_lock(&fMutex);
+        fQueue.append(job);
+        pthread_cond_signal(&fWork);
+        pthread_mutex_unlock(&fMutex);
+    }
+    if (window && find(fWaiting, Window(window->handle())) < 0)
+        fWaiting.append(window->handle());
+    return true;
+}
+
+void YIconLoader::work() {
+    pthread_mutex_lock(&fMutex);
+    while (fStop == false) {
+        if (fQueue.getCount() == 0) {
+            pthread_cond_wait(&fWork, &fMutex);
+            continue;
+        }
+        Job* job = fQueue[0];
+        fQueue.remove(0);
+        pthread_mutex_unlock(&fMutex);
+
+        ref<YImage> image(YImage::load(job->path));
+        if (image != null)
+            image = image->scale(job->pixels, job->pixels);
+        job->image = image;
+        image = null;
+
+        pthread_mutex_lock(&fMutex);
+        fDone.append(job);
+        if (fDone.getCount() == 1) {
+            char c = 0;
+            if (write(fPipe[1], &c, 1) != 1) { }
+        }
+    }
+    pthread_mutex_unlock(&fMutex);
+}
+
+void YIconLoader::notifyRead() {
+    char buf[64];
+    while (read(fPipe[0], buf, sizeof buf) > 0) { }
+
+    pthread_mutex_lock(&fMutex);
+    YArray<Job*> done(fDone);
+    pthread_mutex_unlock(&fMutex);
+
+    for (int i = 0; i < done.getCount(); ++i) {
+        Job* job = done[i];
+        if (job->image != null)
+            ++fDecoded;
+        else
+            ++fFailed;
+        job->icon->fLoading &= ~(1 << job->size);
+        job->icon->receive(job->size, job->image);
+        delete[] job->path;
+        delete job;
+    }
+
+    // Windows still waiting for other icons ask again while painting.
+    YArray<Window> waiting(fWaiting);
+    for (int i = 0; i < waiting.getCount(); ++i) {
+        YWindow* window = windowContext.find(waiting[i]);
+        if (window && window->visible()) {
+            window->repaint();
+            ++fRepaints;
+        }
+    }
+}
+
+void YIconLoader::statistics() {
+    tlog("icon loader: %d threads, %lu decoded, %lu failed, %lu repaints",
+         fThreadCount, fDecoded, fFailed, fRepaints);
+}
 
 YIcon::YIcon(upath filename):
     fSmall(null), fLarge(null), fHuge(null),
     loadedS(false), loadedL(false), loadedH(false),
-    fPath(filename), fCached(false)
+    fPath(filename), fCached(false), fLoading(0)
 {
+    for (int i = 0; i < Sizes; ++i) {
+        fUsage[i].older = fUsage[i].newer = 0;
+        fUsage[i].icon = this;
+        fUsage[i].bytes = 0;
+    }
 }
 
 YIcon::YIcon(ref<YImage> small, ref<YImage> large, ref<YImage> huge) :
     fSmall(small), fLarge(large), fHuge(huge),
     loadedS(small != null), loadedL(large != null), loadedH(huge != null),
-    fPath(null), fCached(false)
+    fPath(null), fCached(false), fLoading(0)
 {
+    for (int i = 0; i < Sizes; ++i) {
+        fUsage[i].older = fUsage[i].newer = 0;
+        fUsage[i].icon = this;
+        fUsage[i].bytes = 0;
+    }
 }
 
 YIcon::~YIcon() {
@@ -92,8 +543,17 @@ static upath joinPath(const upath& dir, const upath& name) {
 }
 
 static inline bool isIconFile(const upath& name) {
-    bool exist = name.fileExists();
-    return exist;
+    YIconIndex::Answer known = iconIndex->fileExists(name);
+    if (known != YIconIndex::Unknown)
+        return known == YIconIndex::Present;
+    return name.fileExists();
+}
+
+static inline bool isIconDir(const upath& name) {
+    YIconIndex::Answer known = iconIndex->dirExists(name);
+    if (known != YIconIndex::Unknown)
+        return known == YIconIndex::Present;
+    return name.dirExists();
 }
 
 upath YIcon::findIcon(upath dir, upath base, unsigned size) {
@@ -162,7 +622,7 @@ upath YIcon::findIcon(upath dir, upath base, unsigned size) {
         for (const char **p = xdg_folder_patterns; *p; ++p) {
             snprintf(iconName, iconSize, *p, size, size);
             upath apps(dir + iconName);
-            if (apps.dirExists()) {
+            if (isIconDir(apps)) {
                 for (int i = 0; i < numIconExts; ++i) {
                     snprintf(iconName, iconSize, "/%s%s", cBaseStr,
                             iconExts[i]);
@@ -199,21 +659,21 @@ upath YIcon::findIcon(unsigned size) {
     return null;
 }
 
+upath YIcon::iconFile(unsigned size) {
+    if (fPath == null)
+        return null;
+    if (fPath.isAbsolute() && fPath.fileExists())
+        return fPath;
+    return findIcon(size);
+}
+
 ref<YImage> YIcon::loadIcon(unsigned size) {
     ref<YImage> icon;
 
-    if (fPath != null) {
-        upath loadPath;
-
-        if (fPath.isAbsolute() && fPath.fileExists()) {
-            loadPath = fPath;
-        } else {
-            loadPath = findIcon(size);
-        }
-        if (loadPath != null) {
-            cstring cs(loadPath.path());
-            icon = YImage::load(cs.c_str());
-        }
+    upath loadPath(iconFile(size));
+    if (loadPath != null) {
+        cstring cs(loadPath.path());
+        icon = YImage::load(cs.c_str());
     }
 #if 1
     if (icon != null) {
@@ -235,7 +695,7 @@ ref<YImage> YIcon::huge() {
             fHuge = small()->scale(hugeSize(), hugeSize());
     }
 
-    return fHuge;
+    return cached(Huge, fHuge);
 }
 
 ref<YImage> YIcon::large() {
@@ -250,7 +710,7 @@ ref<YImage> YIcon::large() {
             fLarge = small()->scale(largeSize(), largeSize());
     }
 
-    return fLarge;
+    return cached(Large, fLarge);
 }
 
 ref<YImage> YIcon::small() {
@@ -264,7 +724,51 @@ ref<YImage> YIcon::small() {
             fSmall = huge()->scale(smallSize(), smallSize());
     }
 
-    return fSmall;
+    return cached(Small, fSmall);
+}
+
+ref<YImage> YIcon::cached(int size, ref<YImage>& image) {
+    if (fCached)
+        iconCache.touch(&fUsage[size], image);
+    return image;
+}
+
+bool YIcon::loaded(int size) const {
+    switch (size) {
+        case Small: return loadedS;
+        case Large: return loadedL;
+        case Huge: return loadedH;
+    }
+    return true;
+}
+
+// An image from the background loader.  When the file could not be
+// decoded, the size is derived from the other sizes as usual.
+void YIcon::receive(int size, ref<YImage> image) {
+    if (loaded(size))
+        return;
+    if (image == null) {
+        switch (size) {
+            case Small: small(); break;
+            case Large: large(); break;
+            case Huge: huge(); break;
+        }
+        return;
+    }
+    switch (size) {
+        case Small: fSmall = image; loadedS = true; break;
+        case Large: fLarge = image; loadedL = true; break;
+        case Huge: fHuge = image; loadedH = true; break;
+    }
+    cached(size, image);
+}
+
+void YIcon::release(int size) {
+    switch (size) {
+        case Small: fSmall = null; loadedS = false; break;
+        case Large: fLarge = null; loadedL = false; break;
+        case Huge: fHuge = null; loadedH = false; break;
+    }
 }
 
 ref<YImage> YIcon::getScaledIcon(unsigned size) {
@@ -294,58 +798,20 @@ ref<YImage> YIcon::getScaledIcon(unsigned size) {
 }
 
 
-static YRefArray<YIcon> iconCache;
-
-void YIcon::removeFromCache() {
-    int n = cacheFind(iconName());
-    if (n >= 0) {
-        fPath = null;
-        iconCache.remove(n);
-    }
-}
-
-int YIcon::cacheFind(upath name) {
-    int l, r, m;
-
-    l = 0;
-    r = iconCache.getCount();
-    while (l < r) {
-        m = (l + r) / 2;
-        ref<YIcon> found = iconCache.getItem(m);
-        int cmp = name.path().compareTo(found->iconName().path());
-        if (cmp == 0) {
-            return m;
-        } else if (cmp < 0)
-            r = m;
-        else
-            l = m + 1;
-    }
-    return -(l + 1);
-}
-
 ref<YIcon> YIcon::getIcon(const char *name) {
-    int n = cacheFind(name);
-    if (n >= 0)
-        return iconCache.getItem(n);
-
-    ref<YIcon>newicon(new YIcon(name));
-    if (newicon != null) {
-        newicon->setCached(true);
-        iconCache.insert(-n - 1, newicon);
+    ref<YIcon> icon(iconCache.find(name));
+    if (icon == null) {
+        icon.init(new YIcon(name));
+        icon->setCached(true);
+        iconCache.insert(icon);
     }
-    return newicon;
+    return icon;
 }
 
 void YIcon::freeIcons() {
-    for (int k = iconCache.getCount(); --k >= 0; ) {
-        ref<YIcon> icon = iconCache.getItem(k);
-        icon->fPath = null;
-        icon->fSmall = null;
-        icon->fLarge = null;
-        icon->fHuge = null;
-        icon = null;
-        iconCache.remove(k);
-    }
+    delete iconLoader; iconLoader = 0;
+    iconCache.clear();
+    delete iconIndex; iconIndex = 0;
     if (iconPaths != null) {
         iconPaths->clear();
         iconPaths = null;
@@ -353,6 +819,14 @@ void YIcon::freeIcons() {
     iconDirs.clear();
 }
 
+void YIcon::statistics() {
+    iconCache.statistics();
+    if (iconIndex)
+        iconIndex->statistics();
+    if (iconLoader)
+        iconLoader->statistics();
+}
+
 unsigned YIcon::menuSize() {
     return menuIconSize;
 }
@@ -382,4 +856,19 @@ bool YIcon::draw(Graphics &g, int x, int y, int size) {
     return false;
 }
 
+bool YIcon::draw(Graphics &g, int x, int y, int size, YWindow *window) {
+#ifdef CONFIG_ICON_LOADER
+    // getScaledIcon starts from the huge size for other sizes.
+    int slot = unsigned(size) == smallSize() ? Small :
+               unsigned(size) == largeSize() ? Large : Huge;
+    if (fPath != null && loaded(slot) == false) {
+        if (iconLoader == 0)
+            iconLoader = new YIconLoader();
+        if (iconLoader->request(this, slot, window))
+            return false;
+    }
+#endif
+    return draw(g, x, y, size);
+}
+
 // vim: set sw=4 ts=4 et:
@@ -1,6 +1,8 @@
 #ifndef YICON_H
 #define YICON_H
 
+class YWindow;
+
 class YIcon: public refcounted {
 public:
     YIcon(upath fileName);
@@ -17,6 +19,7 @@ public:
 
     static ref<YIcon> getIcon(const char *name);
     static void freeIcons();
+    static void statistics();
     bool isCached() { return fCached; }
     void setCached(bool cached) { fCached = cached; }
 
@@ -26,6 +29,9 @@ public:
     static unsigned hugeSize();
 
     bool draw(Graphics &g, int x, int y, int size);
+    // Draw only if the image is decoded, otherwise decode it in the
+    // background and repaint window when it arrives.
+    bool draw(Graphics &g, int x, int y, int size, YWindow *window);
 
 private:
     ref<YImage> fSmall;
@@ -39,11 +45,27 @@ private:
     upath fPath;
     bool fCached;
 
+    // Position of one decoded size in the least-recently-used order.
+    enum { Small, Large, Huge, Sizes };
+    struct Usage {
+        Usage* older;
+        Usage* newer;
+        YIcon* icon;
+        unsigned long bytes;
+    };
+    Usage fUsage[Sizes];
+    int fLoading;       // bit mask of the sizes in the background loader
+    friend class YIconCache;
+    friend class YIconLoader;
+
     upath findIcon(upath dir, upath base, unsigned size);
     upath findIcon(unsigned size);
-    void removeFromCache();
-    static int cacheFind(upath name);
+    upath iconFile(unsigned size);
     ref<YImage> loadIcon(unsigned size);
+    bool loaded(int size) const;
+    void receive(int size, ref<YImage> image);
+    ref<YImage> cached(int size, ref<YImage>& image);
+    void release(int size);
 };
 
 #endif
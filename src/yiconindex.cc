@@ -0,0 +1,435 @@
+/*
+ * IceWM - persistent index of icon file names
+ */
+#include "config.h"
+#include "yiconindex.h"
+#include "ytimer.h"
+#include "base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*
+ * File layout: a header, the key padded to 8 bytes, the directory
+ * stamps, the hash slots and a pool of null-terminated paths.
+ * The file is only shared between programs on the same host,
+ * so it uses the native byte order.
+ */
+static const char indexMagic[8] = { 'I', 'C', 'E', 'I', 'D', 'X', '0', '1' };
+
+struct YIconIndex::Header {
+    char magic[8];
+    uint32_t keyLength;
+    uint32_t stampCount;
+    uint32_t slotCount;
+    uint32_t poolSize;
+};
+
+// Modification time of an indexed directory, or -1 if it was missing.
+struct YIconIndex::Stamp {
+    uint32_t path;
+    uint32_t nsec;
+    int64_t sec;
+};
+
+struct YIconIndex::Slot {
+    uint32_t hash;
+    uint32_t path;
+    uint32_t kind;
+};
+
+enum { Empty, File, Dir, Missing };
+
+// Directories are rechecked for changes at most this often.
+static const long refreshSeconds = 10;
+
+static unsigned pad8(unsigned n) {
+    return (n + 7) & ~7U;
+}
+
+static uint32_t hashPath(const char* path, unsigned length) {
+    uint32_t hash = 2166136261U;
+    for (unsigned i = 0; i < length; ++i)
+        hash = (hash ^ (unsigned char) path[i]) * 16777619U;
+    return hash;
+}
+
+static bool modified(const char* path, int64_t* sec, uint32_t* nsec) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return false;
+    *sec = st.st_mtime;
+#if defined(__linux__)
+    *nsec = uint32_t(st.st_mtim.tv_nsec);
+#else
+    *nsec = 0;
+#endif
+    return true;
+}
+
+static mstring stripSlashes(const mstring& path) {
+    int length = int(path.length());
+    while (length > 1 && path[length - 1] == '/')
+        --length;
+    return path.substring(0, size_t(length));
+}
+
+YIconIndex::YIconIndex(const MStringArray& dirs,
+                       const unsigned* sizes, int count,
+                       const upath& cacheFile):
+    fData(0),
+    fSize(0),
+    fMapped(false),
+    fChecked(seconds()),
+    fKey("icons"),
+    fCacheFile(cacheFile),
+    fLookups(0),
+    fUnknown(0),
+    fBuilds(0)
+{
+    YArray<unsigned> unique;
+    for (int i = 0; i < count; ++i) {
+        if (find(unique, sizes[i]) < 0) {
+            unique.append(sizes[i]);
+            char buf[16];
+            snprintf(buf, sizeof buf, " %u", sizes[i]);
+            fKey = fKey + buf;
+        }
+    }
+
+    for (int i = 0; i < dirs.getCount(); ++i) {
+        mstring root(stripSlashes(dirs[i]));
+        if (root.isEmpty() || find(fDirs, root) >= 0)
+            continue;
+        fKey = fKey + "\n" + root;
+        fDirs.append(root);
+        for (int k = 0; k < unique.getCount(); ++k) {
+            char buf[64];
+            snprintf(buf, sizeof buf, "/%ux%u", unique[k], unique[k]);
+            mstring sized(root + buf);
+            fDirs.append(sized);
+            fDirs.append(sized + "/apps");
+            fDirs.append(sized + "/categories");
+        }
+    }
+
+    if (fCacheFile.nonempty()) {
+        char buf[16];
+        snprintf(buf, sizeof buf, "-%08x",
+                 hashPath(cstring(fKey).c_str(), unsigned(fKey.length())));
+        fCacheFile = fCacheFile.path() + buf;
+    }
+
+    if (load() == false) {
+        release();
+        build();
+        save();
+    }
+}
+
+YIconIndex::~YIconIndex() {
+    release();
+}
+
+const YIconIndex::Header* YIconIndex::header() const {
+    return reinterpret_cast<const Header*>(fData);
+}
+
+const YIconIndex::Stamp* YIconIndex::stamps() const {
+    return reinterpret_cast<const Stamp*>(
+        fData + sizeof(Header) + pad8(header()->keyLength));
+}
+
+const YIconIndex::Slot* YIconIndex::slots() const {
+    return reinterpret_cast<const Slot*>(
+        stamps() + header()->stampCount);
+}
+
+const char* YIconIndex::pool() const {
+    return reinterpret_cast<const char*>(
+        slots() + header()->slotCount);
+}
+
+void YIconIndex::release() {
+    if (fMapped)
+        munmap(fData, fSize);
+    else
+        delete[] fData;
+    fData = 0;
+    fSize = 0;
+    fMapped = false;
+}
+
+bool YIconIndex::load() {
+    if (fCacheFile.isEmpty())
+        return false;
+
+    int fd = fCacheFile.open(O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(Header))
+        map = mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    fData = static_cast<char*>(map);
+    fSize = unsigned(st.st_size);
+    fMapped = true;
+
+    const Header* head = header();
+    if (memcmp(head->magic, indexMagic, sizeof indexMagic) ||
+        head->keyLength != fKey.length() ||
+        memcmp(fData + sizeof(Header), cstring(fKey).c_str(), fKey.length()) ||
+        head->slotCount == 0 ||
+        (head->slotCount & (head->slotCount - 1)) ||
+        head->poolSize == 0 ||
+        fSize != sizeof(Header) + pad8(head->keyLength) +
+                 head->stampCount * sizeof(Stamp) +
+                 head->slotCount * sizeof(Slot) + head->poolSize ||
+        pool()[head->poolSize - 1] != '\0')
+    {
+        return false;
+    }
+    for (unsigned i = 0; i < head->stampCount; ++i) {
+        if (stamps()[i].path >= head->poolSize)
+            return false;
+    }
+    for (unsigned i = 0; i < head->slotCount; ++i) {
+        if (slots()[i].path >= head->poolSize)
+            return false;
+    }
+
+    return valid();
+}
+
+bool YIconIndex::valid() const {
+    const Stamp* stamp = stamps();
+    for (unsigned i = 0; i < header()->stampCount; ++i, ++stamp) {
+        int64_t sec = -1;
+        uint32_t nsec = 0;
+        modified(pool() + stamp->path, &sec, &nsec);
+        if (sec != stamp->sec || nsec != stamp->nsec)
+            return false;
+    }
+    return true;
+}
+
+void YIconIndex::build() {
+    MStringArray paths;
+    YArray<unsigned> kinds;
+    YArray<int> stamped;
+    YArray<int64_t> secs;
+    YArray<uint32_t> nsecs;
+
+    for (int i = 0; i < fDirs.getCount(); ++i) {
+        const mstring& dir(fDirs[i]);
+        cstring cdir(dir);
+
+        // Skip stamps below a missing directory: its creation
+        // already changes the stamp of the missing directory.
+        bool below = false;
+        for (int k = 0; k < stamped.getCount(); ++k) {
+            if (secs[k] == -1 && dir.startsWith(paths[stamped[k]] + "/"))
+                below = true;
+        }
+
+        int64_t sec = -1;
+        uint32_t nsec = 0;
+        bool exists = modified(cdir, &sec, &nsec);
+        if (below == false) {
+            stamped.append(paths.getCount());
+            secs.append(sec);
+            nsecs.append(nsec);
+        }
+        paths.append(dir);
+        kinds.append(exists ? Dir : Missing);
+
+        DIR* dp = exists ? opendir(cdir) : 0;
+        for (struct dirent* de; dp && (de = readdir(dp)) != 0; ) {
+            if (de->d_name[0] == '.' &&
+                (de->d_name[1] == 0 ||
+                 (de->d_name[1] == '.' && de->d_name[2] == 0)))
+                continue;
+
+            mstring path(dir + "/" + de->d_name);
+            bool regular = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+            if (de->d_type == DT_REG)
+                regular = true;
+            else if (de->d_type == DT_LNK || de->d_type == DT_UNKNOWN)
+#endif
+            {
+                struct stat st;
+                regular = (stat(cstring(path), &st) == 0 &&
+                           S_ISREG(st.st_mode));
+            }
+            if (regular) {
+                paths.append(path);
+                kinds.append(File);
+            }
+        }
+        if (dp)
+            closedir(dp);
+    }
+
+    unsigned slotCount = 16;
+    while (slotCount < 2U * paths.getCount())
+        slotCount *= 2;
+    unsigned poolSize = 0;
+    for (int i = 0; i < paths.getCount(); ++i)
+        poolSize += unsigned(paths[i].length()) + 1;
+    if (poolSize == 0)
+        poolSize = 1;
+
+    fSize = unsigned(sizeof(Header) + pad8(unsigned(fKey.length())) +
+                     stamped.getCount() * sizeof(Stamp) +
+                     slotCount * sizeof(Slot) + poolSize);
+    fData = new char[fSize];
+    fMapped = false;
+    memset(fData, 0, fSize);
+
+    Header* head = reinterpret_cast<Header*>(fData);
+    memcpy(head->magic, indexMagic, sizeof indexMagic);
+    head->keyLength = unsigned(fKey.length());
+    head->stampCount = unsigned(stamped.getCount());
+    head->slotCount = slotCount;
+    head->poolSize = poolSize;
+    memcpy(fData + sizeof(Header), cstring(fKey).c_str(), fKey.length());
+
+    char* text = const_cast<char*>(pool());
+    Slot* slot = const_cast<Slot*>(slots());
+    YArray<uint32_t> offsets;
+    uint32_t offset = 0;
+    for (int i = 0; i < paths.getCount(); ++i) {
+        cstring path(paths[i]);
+        unsigned length = unsigned(path.c_str_len());
+        memcpy(text + offset, path.c_str(), length);
+        offsets.append(offset);
+
+        uint32_t hash = hashPath(text + offset, length);
+        unsigned k = hash & (slotCount - 1);
+        while (slot[k].kind != Empty)
+            k = (k + 1) & (slotCount - 1);
+        slot[k].hash = hash;
+        slot[k].path = offset;
+        slot[k].kind = kinds[i];
+
+        offset += length + 1;
+    }
+
+    Stamp* stamp = const_cast<Stamp*>(stamps());
+    for (int i = 0; i < stamped.getCount(); ++i) {
+        stamp[i].path = offsets[stamped[i]];
+        stamp[i].sec = secs[i];
+        stamp[i].nsec = nsecs[i];
+    }
+
+    ++fBuilds;
+}
+
+void YIconIndex::save() const {
+    if (fCacheFile.isEmpty() || fData == 0)
+        return;
+
+    char suffix[32];
+    snprintf(suffix, sizeof suffix, ".%d", int(getpid()));
+    upath temp(fCacheFile.addExtension(suffix));
+    int fd = temp.open(O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return;
+
+    bool written = (write(fd, fData, fSize) == ssize_t(fSize));
+    if (close(fd) == 0 && written)
+        written = (temp.renameAs(fCacheFile.path()) == 0);
+    if (written == false)
+        temp.remove();
+}
+
+void YIconIndex::refresh() {
+    long now = seconds();
+    if (now - fChecked >= refreshSeconds) {
+        fChecked = now;
+        if (valid() == false) {
+            release();
+            build();
+            save();
+        }
+    }
+}
+
+unsigned YIconIndex::lookup(const char* path, unsigned length) {
+    const Slot* slot = slots();
+    const unsigned mask = header()->slotCount - 1;
+    const uint32_t hash = hashPath(path, length);
+    for (unsigned k = hash & mask; slot[k].kind != Empty; k = (k + 1) & mask) {
+        if (slot[k].hash == hash) {
+            const char* name = pool() + slot[k].path;
+            if (strncmp(name, path, length) == 0 && name[length] == '\0')
+                return slot[k].kind;
+        }
+    }
+    return Empty;
+}
+
+YIconIndex::Answer YIconIndex::fileExists(const upath& path) {
+    refresh();
+    ++fLookups;
+
+    cstring cs(path.string());
+    const char* str = cs.c_str();
+    const char* sep = strrchr(str, '/');
+    if (sep == 0 || sep[1] == '\0') {
+        ++fUnknown;
+        return Unknown;
+    }
+
+    unsigned dirLength = unsigned(sep - str);
+    while (dirLength > 1 && str[dirLength - 1] == '/')
+        --dirLength;
+    if (lookup(str, dirLength) != Dir) {
+        ++fUnknown;
+        return Unknown;
+    }
+
+    unsigned kind;
+    if (str + dirLength == sep) {
+        kind = lookup(str, unsigned(cs.c_str_len()));
+    } else {
+        cstring norm(mstring(str, dirLength) + sep);
+        kind = lookup(norm.c_str(), unsigned(norm.c_str_len()));
+    }
+    return kind == File ? Present : Absent;
+}
+
+YIconIndex::Answer YIconIndex::dirExists(const upath& path) {
+    refresh();
+    ++fLookups;
+
+    cstring dir(stripSlashes(path.path()));
+    switch (lookup(dir.c_str(), unsigned(dir.c_str_len()))) {
+        case Dir: return Present;
+        case Missing: return Absent;
+    }
+    ++fUnknown;
+    return Unknown;
+}
+
+void YIconIndex::statistics() {
+    tlog("icon index: %u stamps, %u slots, %u KB, "
+         "%lu lookups, %lu not indexed, %lu builds",
+         header()->stampCount, header()->slotCount, fSize / 1024,
+         fLookups, fUnknown, fBuilds);
+}
+
+// vim: set sw=4 ts=4 et:
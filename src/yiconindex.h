@@ -0,0 +1,68 @@
+#ifndef YICONINDEX_H
+#define YICONINDEX_H
+
+#include "upath.h"
+#include "yarray.h"
+
+/*
+ * The names of all files in the directories which YIcon::findIcon
+ * probes: each icon directory itself and its <size>x<size>/apps
+ * and <size>x<size>/categories subdirectories.  The index is stored
+ * in a file which is mapped into memory on startup.  The file name
+ * has a hash of the sizes and directories, so programs which index
+ * different icons keep their own files.  The index is rebuilt
+ * when the set of icon directories changes, or when the modification
+ * time of one of the indexed directories changes.
+ */
+class YIconIndex {
+public:
+    enum Answer { Unknown, Absent, Present };
+
+    YIconIndex(const MStringArray& dirs, const unsigned* sizes, int count,
+               const upath& cacheFile);
+    ~YIconIndex();
+
+    // Unknown when the parent directory of path is not indexed.
+    Answer fileExists(const upath& path);
+    Answer dirExists(const upath& path);
+
+    void statistics();
+
+private:
+    YIconIndex(const YIconIndex&);
+    YIconIndex& operator=(const YIconIndex&);
+
+    struct Header;
+    struct Stamp;
+    struct Slot;
+
+    char* fData;
+    unsigned fSize;
+    bool fMapped;
+    long fChecked;
+
+    mstring fKey;
+    MStringArray fDirs;
+    upath fCacheFile;
+
+    unsigned long fLookups;
+    unsigned long fUnknown;
+    unsigned long fBuilds;
+
+    const Header* header() const;
+    const Stamp* stamps() const;
+    const Slot* slots() const;
+    const char* pool() const;
+
+    bool load();
+    bool valid() const;
+    void build();
+    void save() const;
+    void release();
+    void refresh();
+    unsigned lookup(const char* path, unsigned length);
+};
+
+#endif
+
+// vim: set sw=4 ts=4 et:
@@ -585,7 +585,8 @@ void YListBox::paintItem(Graphics &g, int n) {
     ref<YIcon> icon = a->getIcon();
 
     if (icon != null)
-        icon->draw(g, xpos + x - fOffsetX, y - fOffsetY + 1, YIcon::smallSize());
+        icon->draw(g, xpos + x - fOffsetX, y - fOffsetY + 1, YIcon::smallSize(),
+                   this);
 
     ustring title = a->getText();
 
@@ -1082,7 +1082,7 @@ void YMenu::paintItem(Graphics &g, const int i, const int l, const int t, const
                                l + 1 + delta, t + delta + top + pad +
                                (eh - top - pad * 2 - bottom -
                                 YIcon::menuSize()) / 2,
-                                YIcon::menuSize());
+                                YIcon::menuSize(), this);
                 }
 
                 if (name != null) {
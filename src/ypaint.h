@@ -39,6 +39,7 @@ struct YDimension {
 class YFont: public virtual refcounted {
 public:
     static ref<YFont> getFont(ustring name, ustring xftFont, bool antialias = true);
+    static void statistics();
 
     virtual ~YFont() {}
 
@@ -1,6 +1,12 @@
 #ifndef __YPOLL_H__
 #define __YPOLL_H__
 
+/*
+ * A file descriptor which is multiplexed by the main loop.
+ * The main loop samples forRead and forWrite when the poll
+ * is registered. A poll which changes its interest while it
+ * is registered must call registerPoll again to update it.
+ */
 class YPollBase {
 public:
     YPollBase(): fFd(-1), fPrev(0), fNext(0) { }
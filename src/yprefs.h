@@ -26,6 +26,7 @@ XIV(int, autoScrollStartDelay,                  500)
 XIV(int, autoScrollDelay,                       60)
 XIV(int, ToolTipDelay,                          500)
 XIV(int, ToolTipTime,                           0)
+XIV(int, iconCacheSize,                         8192)
 
 ///#warning "move this one back to WM"
 XIV(bool, grabRootWindow,                       true)
@@ -0,0 +1,106 @@
+/*
+ * IceWM - persistent readers of procfs and sysfs files
+ */
+#include "config.h"
+#include "base.h"
+#include "yprocfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+unsigned long YProcFile::fOpens;
+unsigned long YProcFile::fReads;
+
+YProcFile::YProcFile(const char* path):
+    fPath(newstr(path)),
+    fFd(-1),
+    fText(0),
+    fSize(0),
+    fLength(0)
+{
+}
+
+YProcFile::~YProcFile() {
+    close();
+    free(fText);
+    delete[] fPath;
+}
+
+void YProcFile::setPath(const char* path) {
+    close();
+    delete[] fPath;
+    fPath = newstr(path);
+}
+
+void YProcFile::close() {
+    if (fFd >= 0) {
+        ::close(fFd);
+        fFd = -1;
+    }
+    fLength = 0;
+}
+
+// Whether the text has a line which does not start with prefix.
+bool YProcFile::complete(const char* prefix) const {
+    const size_t len = strlen(prefix);
+    for (const char* line = fText; line < fText + fLength; ) {
+        const char* next = strchr(line, '\n');
+        if (next == 0)
+            return false;
+        if (strncmp(line, prefix, len))
+            return true;
+        line = next + 1;
+    }
+    return false;
+}
+
+int YProcFile::read(const char* prefix) {
+    if (fFd < 0) {
+        if (fPath == 0)
+            return -1;
+        fFd = open(fPath, O_RDONLY | O_CLOEXEC);
+        ++fOpens;
+        if (fFd < 0)
+            return -1;
+    }
+    if (fText == 0) {
+        fSize = 4096;
+        fText = (char *) malloc(fSize);
+        if (fText == 0) {
+            fSize = 0;
+            return -1;
+        }
+    }
+
+    for (;;) {
+        ssize_t len = pread(fFd, fText, fSize - 1, 0);
+        ++fReads;
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0) {
+            close();
+            return -1;
+        }
+        fText[len] = '\0';
+        fLength = int(len);
+
+        if (size_t(len) < fSize - 1 || (prefix && complete(prefix)))
+            return fLength;
+
+        char* text = (char *) realloc(fText, 2 * fSize);
+        if (text == 0)
+            return fLength;
+        fText = text;
+        fSize *= 2;
+    }
+}
+
+void YProcFile::statistics() {
+    if (fReads)
+        tlog("procfs: %lu opens, %lu reads", fOpens, fReads);
+}
+
+// vim: set sw=4 ts=4 et:
@@ -0,0 +1,56 @@
+#ifndef YPROCFILE_H
+#define YPROCFILE_H
+
+#include <stddef.h>
+
+/*
+ * A file in procfs or sysfs which is read again on each update.
+ * The descriptor stays open and every read is a single pread from
+ * the start into a buffer which is kept, so an update costs one
+ * system call and no allocation.  The text is zero-terminated and
+ * may be modified in place by the parser until the next read.
+ * When a read fails, the file is opened again on the next read.
+ */
+class YProcFile {
+public:
+    explicit YProcFile(const char* path = 0);
+    ~YProcFile();
+
+    // Select another file; the previous one is closed.
+    void setPath(const char* path);
+    const char* path() const { return fPath; }
+
+    // Read the file again.  With a prefix, the buffer only grows as
+    // long as all complete lines in it start with prefix.
+    // The length of the text is returned, or -1 on failure.
+    int read(const char* prefix = 0);
+
+    char* text() const { return fText; }
+    int length() const { return fLength; }
+    bool isOpen() const { return fFd >= 0; }
+    void close();
+
+    // The number of system calls made by all files.
+    static unsigned long opens() { return fOpens; }
+    static unsigned long reads() { return fReads; }
+    static void statistics();
+
+private:
+    YProcFile(const YProcFile&);
+    YProcFile& operator=(const YProcFile&);
+
+    bool complete(const char* prefix) const;
+
+    char* fPath;
+    int fFd;
+    char* fText;
+    size_t fSize;
+    int fLength;
+
+    static unsigned long fOpens;
+    static unsigned long fReads;
+};
+
+#endif
+
+// vim: set sw=4 ts=4 et:
@@ -0,0 +1,162 @@
+/*
+ * IceWM - grid index of rectangles
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "yrectgrid.h"
+
+YRectGrid::YRectGrid():
+    fQuery(0),
+    fLeft(0), fTop(0),
+    fCellWidth(1), fCellHeight(1),
+    fColumns(0), fRows(0)
+{
+}
+
+// Cells are closed on both sides, so touching rectangles share one.
+int YRectGrid::column(int x) const {
+    return clamp((x - fLeft) / fCellWidth, 0, fColumns - 1);
+}
+
+int YRectGrid::row(int y) const {
+    return clamp((y - fTop) / fCellHeight, 0, fRows - 1);
+}
+
+void YRectGrid::build() {
+    const int n = fRects.getCount();
+    fFirst.clear();
+    fCells.clear();
+    fSeen.clear();
+    fColumns = fRows = 0;
+    if (n == 0)
+        return;
+
+    int right = fRects[0].x() + int(fRects[0].width());
+    int bottom = fRects[0].y() + int(fRects[0].height());
+    fLeft = fRects[0].x();
+    fTop = fRects[0].y();
+    for (int i = 1; i < n; ++i) {
+        fLeft = min(fLeft, fRects[i].x());
+        fTop = min(fTop, fRects[i].y());
+        right = max(right, fRects[i].x() + int(fRects[i].width()));
+        bottom = max(bottom, fRects[i].y() + int(fRects[i].height()));
+    }
+
+    // About one rectangle per cell when they are evenly spread.
+    int side = 1;
+    while (side * side < n && side < 64)
+        ++side;
+    fColumns = fRows = side;
+    fCellWidth = max(1, (right - fLeft + side) / side);
+    fCellHeight = max(1, (bottom - fTop + side) / side);
+
+    const int cells = fColumns * fRows;
+    fFirst.setCapacity(cells + 1);
+    for (int c = 0; c <= cells; ++c)
+        fFirst.append(0);
+    for (int i = 0; i < n; ++i) {
+        const YRect& r = fRects[i];
+        int c0 = column(r.x()), c1 = column(r.x() + int(r.width()));
+        int r0 = row(r.y()), r1 = row(r.y() + int(r.height()));
+        for (int y = r0; y <= r1; ++y)
+            for (int x = c0; x <= c1; ++x)
+                fFirst[y * fColumns + x + 1] += 1;
+    }
+    for (int c = 0; c < cells; ++c)
+        fFirst[c + 1] += fFirst[c];
+
+    YArray<int> fill;
+    fill.setCapacity(cells);
+    for (int c = 0; c < cells; ++c)
+        fill.append(fFirst[c]);
+    fCells.setCapacity(fFirst[cells]);
+    for (int k = 0; k < fFirst[cells]; ++k)
+        fCells.append(0);
+    for (int i = 0; i < n; ++i) {
+        const YRect& r = fRects[i];
+        int c0 = column(r.x()), c1 = column(r.x() + int(r.width()));
+        int r0 = row(r.y()), r1 = row(r.y() + int(r.height()));
+        for (int y = r0; y <= r1; ++y)
+            for (int x = c0; x <= c1; ++x)
+                fCells[fill[y * fColumns + x]++] = i;
+    }
+
+    fSeen.setCapacity(n);
+    for (int i = 0; i < n; ++i)
+        fSeen.append(0);
+    fQuery = 0;
+}
+
+void YRectGrid::nextQuery() const {
+    if (++fQuery == 0) {
+        for (int i = 0; i < fSeen.getCount(); ++i)
+            fSeen[i] = 0;
+        fQuery = 1;
+    }
+}
+
+// Whether a rectangle is seen for the first time in this query.
+bool YRectGrid::visit(int index) const {
+    if (fSeen[index] == fQuery)
+        return false;
+    fSeen[index] = fQuery;
+    return true;
+}
+
+static int compareIndex(const void* p1, const void* p2) {
+    return *(const int *) p1 - *(const int *) p2;
+}
+
+void YRectGrid::find(const YRect& area, YArray<int>& found) const {
+    found.shrink(0);
+    if (fColumns == 0)
+        return;
+    nextQuery();
+
+    const int ax2 = area.x() + int(area.width());
+    const int ay2 = area.y() + int(area.height());
+    const int c0 = column(area.x()), c1 = column(ax2);
+    const int r0 = row(area.y()), r1 = row(ay2);
+    for (int y = r0; y <= r1; ++y) {
+        for (int x = c0; x <= c1; ++x) {
+            const int cell = y * fColumns + x;
+            for (int k = fFirst[cell]; k < fFirst[cell + 1]; ++k) {
+                const int i = fCells[k];
+                const YRect& r = fRects[i];
+                if (visit(i) &&
+                    r.x() <= ax2 && area.x() <= r.x() + int(r.width()) &&
+                    r.y() <= ay2 && area.y() <= r.y() + int(r.height()))
+                {
+                    found.append(i);
+                }
+            }
+        }
+    }
+    if (found.getCount() > 1)
+        qsort(&found[0], found.getCount(), sizeof(int), compareIndex);
+}
+
+unsigned long YRectGrid::overlap(const YRect& area) const {
+    unsigned long sum = 0;
+    if (fColumns == 0 || area.pixels() == 0)
+        return sum;
+    nextQuery();
+
+    const int c0 = column(area.x());
+    const int c1 = column(area.x() + int(area.width()) - 1);
+    const int r0 = row(area.y());
+    const int r1 = row(area.y() + int(area.height()) - 1);
+    for (int y = r0; y <= r1; ++y) {
+        for (int x = c0; x <= c1; ++x) {
+            const int cell = y * fColumns + x;
+            for (int k = fFirst[cell]; k < fFirst[cell + 1]; ++k) {
+                if (visit(fCells[k]))
+                    sum += fRects[fCells[k]].overlap(area);
+            }
+        }
+    }
+    return sum;
+}
+
+// vim: set sw=4 ts=4 et:
@@ -0,0 +1,48 @@
+#ifndef YRECTGRID_H
+#define YRECTGRID_H
+
+#include "base.h"
+#include "yrect.h"
+#include "yarray.h"
+
+/*
+ * A uniform grid over a list of rectangles, to find the rectangles
+ * near an area without looking at all of them.  Rectangles keep the
+ * index in which they were added.  The grid is laid out by build,
+ * after all rectangles were added.
+ */
+class YRectGrid {
+public:
+    YRectGrid();
+
+    void add(const YRect& rect) { fRects.append(rect); }
+    void build();
+
+    int count() const { return fRects.getCount(); }
+    const YRect& operator[](int index) const { return fRects[index]; }
+
+    // The rectangles which overlap or touch area, in index order.
+    void find(const YRect& area, YArray<int>& found) const;
+
+    // The sum of the overlaps of all rectangles with area.
+    unsigned long overlap(const YRect& area) const;
+
+private:
+    YArray<YRect> fRects;
+    YArray<int> fFirst;     // per cell, the start of its run in fCells
+    YArray<int> fCells;     // rectangle indices grouped per cell
+    mutable YArray<unsigned> fSeen;
+    mutable unsigned fQuery;
+    int fLeft, fTop;
+    int fCellWidth, fCellHeight;
+    int fColumns, fRows;
+
+    int column(int x) const;
+    int row(int y) const;
+    void nextQuery() const;
+    bool visit(int index) const;
+};
+
+#endif
+
+// vim: set sw=4 ts=4 et:
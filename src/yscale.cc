@@ -0,0 +1,182 @@
+/*
+ * IceWM - fixed-point area-averaging image scaler
+ */
+#include "config.h"
+#include "yscale.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The weights of one target pixel add up to 1 << WeightBits.
+// Horizontally scaled rows keep RowBits of the fraction.
+enum {
+    WeightBits = 14,
+    WeightOne = 1 << WeightBits,
+    RowBits = 7,
+    RowRound = 1 << (WeightBits - RowBits - 1),
+    SumShift = WeightBits + RowBits,
+    SumRound = 1 << (SumShift - 1),
+};
+
+YScaler::Filter::Filter(unsigned source, unsigned target):
+    first(new unsigned[target]),
+    count(new unsigned[target]),
+    offset(new unsigned[target]),
+    weight(new short[target * (source / target + 2)]),
+    widest(1)
+{
+    // Source pixel i spans [i * target, (i + 1) * target) and
+    // target pixel k spans [k * source, (k + 1) * source).
+    unsigned n = 0;
+    for (unsigned k = 0; k < target; ++k) {
+        unsigned long lo = (unsigned long) k * source;
+        unsigned long hi = lo + source;
+        first[k] = unsigned(lo / target);
+        count[k] = unsigned((hi - 1) / target) + 1 - first[k];
+        offset[k] = n;
+        if (widest < count[k])
+            widest = count[k];
+
+        unsigned sum = 0, big = n;
+        for (unsigned i = first[k]; i < first[k] + count[k]; ++i, ++n) {
+            unsigned long left = (unsigned long) i * target;
+            unsigned long right = left + target;
+            unsigned long overlap = (right < hi ? right : hi)
+                                  - (left > lo ? left : lo);
+            weight[n] = short((overlap * WeightOne + source / 2) / source);
+            sum += unsigned(weight[n]);
+            if (weight[big] < weight[n])
+                big = n;
+        }
+        weight[big] += short(WeightOne - int(sum));
+    }
+}
+
+YScaler::Filter::~Filter() {
+    delete[] first;
+    delete[] count;
+    delete[] offset;
+    delete[] weight;
+}
+
+YScaler::YScaler(unsigned sourceWidth, unsigned sourceHeight,
+                 unsigned targetWidth, unsigned targetHeight):
+    fTargetWidth(targetWidth),
+    fTargetHeight(targetHeight),
+    fHorizontal(sourceWidth, targetWidth),
+    fVertical(sourceHeight, targetHeight),
+    fRows(new short[fVertical.widest * targetWidth * 4]),
+    fRowTags(new int[fVertical.widest]),
+    fSums(new int[targetWidth * 4])
+{
+    for (unsigned i = 0; i < fVertical.widest; ++i)
+        fRowTags[i] = -1;
+}
+
+YScaler::~YScaler() {
+    delete[] fRows;
+    delete[] fRowTags;
+    delete[] fSums;
+}
+
+const short* YScaler::row(const unsigned char* source, unsigned stride,
+                          unsigned y)
+{
+    const unsigned slot = y % fVertical.widest;
+    short* out = fRows + slot * fTargetWidth * 4;
+    if (fRowTags[slot] == int(y))
+        return out;
+    fRowTags[slot] = int(y);
+
+    const unsigned char* in = source + y * stride;
+    for (unsigned k = 0; k < fTargetWidth; ++k, out += 4) {
+        const unsigned char* pixel = in + 4 * fHorizontal.first[k];
+        const short* weight = fHorizontal.weight + fHorizontal.offset[k];
+        const unsigned count = fHorizontal.count[k];
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = zero;
+        for (unsigned i = 0; i < count; ++i, pixel += 4) {
+            int bytes;
+            memcpy(&bytes, pixel, 4);
+            __m128i p = _mm_cvtsi32_si128(bytes);
+            p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero);
+            sum = _mm_add_epi32(sum,
+                                _mm_madd_epi16(p, _mm_set1_epi32(weight[i])));
+        }
+        sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(RowRound)),
+                             WeightBits - RowBits);
+        _mm_storel_epi64((__m128i *) out, _mm_packs_epi32(sum, sum));
+#else
+        int s0 = RowRound, s1 = RowRound, s2 = RowRound, s3 = RowRound;
+        for (unsigned i = 0; i < count; ++i, pixel += 4) {
+            s0 += pixel[0] * weight[i];
+            s1 += pixel[1] * weight[i];
+            s2 += pixel[2] * weight[i];
+            s3 += pixel[3] * weight[i];
+        }
+        out[0] = short(s0 >> (WeightBits - RowBits));
+        out[1] = short(s1 >> (WeightBits - RowBits));
+        out[2] = short(s2 >> (WeightBits - RowBits));
+        out[3] = short(s3 >> (WeightBits - RowBits));
+#endif
+    }
+    return fRows + slot * fTargetWidth * 4;
+}
+
+void YScaler::scale(const unsigned char* source, unsigned sourceStride,
+                    unsigned char* target, unsigned targetStride)
+{
+    const unsigned length = fTargetWidth * 4;
+#ifdef __SSE2__
+    const unsigned vector = length & ~7U;
+    const __m128i zero = _mm_setzero_si128();
+#endif
+
+    for (unsigned y = 0; y < fTargetHeight; ++y, target += targetStride) {
+        memset(fSums, 0, length * sizeof(int));
+        const unsigned first = fVertical.first[y];
+        const unsigned count = fVertical.count[y];
+        const short* weight = fVertical.weight + fVertical.offset[y];
+
+        for (unsigned j = 0; j < count; ++j) {
+            const short* in = row(source, sourceStride, first + j);
+            const int w = weight[j];
+            unsigned x = 0;
+#ifdef __SSE2__
+            const __m128i wv = _mm_set1_epi32(w);
+            for (; x < vector; x += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (in + x));
+                __m128i* s = (__m128i *) (fSums + x);
+                _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s),
+                    _mm_madd_epi16(_mm_unpacklo_epi16(v, zero), wv)));
+                _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1),
+                    _mm_madd_epi16(_mm_unpackhi_epi16(v, zero), wv)));
+            }
+#endif
+            for (; x < length; ++x)
+                fSums[x] += in[x] * w;
+        }
+
+        unsigned x = 0;
+#ifdef __SSE2__
+        const __m128i round = _mm_set1_epi32(SumRound);
+        for (; x < vector; x += 8) {
+            __m128i lo = _mm_loadu_si128((const __m128i *) (fSums + x));
+            __m128i hi = _mm_loadu_si128((const __m128i *) (fSums + x + 4));
+            lo = _mm_srli_epi32(_mm_add_epi32(lo, round), SumShift);
+            hi = _mm_srli_epi32(_mm_add_epi32(hi, round), SumShift);
+            __m128i words = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64((__m128i *) (target + x),
+                             _mm_packus_epi16(words, words));
+        }
+#endif
+        for (; x < length; ++x) {
+            int value = (fSums[x] + SumRound) >> SumShift;
+            target[x] = (unsigned char) (value < 255 ? value : 255);
+        }
+    }
+}
+
+// vim: set sw=4 ts=4 et:
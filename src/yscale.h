@@ -0,0 +1,51 @@
+#ifndef YSCALE_H
+#define YSCALE_H
+
+/*
+ * Area-averaging scaler for images with four bytes per pixel.
+ * Each byte is averaged separately, so the byte order of the
+ * channels does not matter.  Weights are fixed-point integers
+ * which are computed once per pair of source and target sizes.
+ */
+class YScaler {
+public:
+    YScaler(unsigned sourceWidth, unsigned sourceHeight,
+            unsigned targetWidth, unsigned targetHeight);
+    ~YScaler();
+
+    void scale(const unsigned char* source, unsigned sourceStride,
+               unsigned char* target, unsigned targetStride);
+
+private:
+    YScaler(const YScaler&);
+    YScaler& operator=(const YScaler&);
+
+    // The source pixels which contribute to each target pixel.
+    struct Filter {
+        Filter(unsigned source, unsigned target);
+        ~Filter();
+
+        unsigned* first;
+        unsigned* count;
+        unsigned* offset;
+        short* weight;
+        unsigned widest;
+    };
+
+    const unsigned fTargetWidth;
+    const unsigned fTargetHeight;
+    Filter fHorizontal;
+    Filter fVertical;
+
+    // Horizontally scaled source rows, used round robin.
+    short* fRows;
+    int* fRowTags;
+    int* fSums;
+
+    const short* row(const unsigned char* source, unsigned stride,
+                     unsigned y);
+};
+
+#endif
+
+// vim: set sw=4 ts=4 et:
@@ -128,10 +128,9 @@ int YSocket::read(char *buf, int len) {
     rdbuf = buf;
     rdbuflen = len;
     reading = true;
-    if (!registered) {
-        registered = true;
-        mainLoop->registerPoll(this);
-    }
+    // also when registered, to update the interest for reading
+    registered = true;
+    mainLoop->registerPoll(this);
     return 0;
 }
 
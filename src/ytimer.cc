@@ -88,8 +88,9 @@ long seconds() {
 }
 
 YTimer::YTimer(long ms) :
-    fListener(0), fInterval(0), fRunning(false), fFixed(false)
+    fListener(0), fInterval(0), fRunning(false), fFixed(false), fSerial(0)
 {
+    fHeapIndex[0] = fHeapIndex[1] = -1;
     if (ms > 0L) {
         setInterval(ms);
     }
@@ -99,8 +100,10 @@ YTimer::YTimer(long ms, YTimerListener* listener, bool start, bool fixed) :
     fListener(listener),
     fInterval(max(0L, ms)),
     fRunning(false),
-    fFixed(fixed)
+    fFixed(fixed),
+    fSerial(0)
 {
+    fHeapIndex[0] = fHeapIndex[1] = -1;
     if (start)
         startTimer();
 }
@@ -133,13 +136,31 @@ void YTimer::startTimer() {
     enlist(true);
 }
 
+/*
+ * Give the first boundary of the coarsest wakeup slot within a range.
+ * Fuzzy timers which expire on the same slot boundaries share wakeups,
+ * even when they were started independently.
+ */
+static timeval alignTimeout(const timeval& earliest, const timeval& latest) {
+    static const long slots[] = { 1000, 500, 250, 100, 50, 20, 10, };
+    const long long begin = earliest.tv_sec * 1000000LL + earliest.tv_usec;
+    for (int i = 0; i < int ACOUNT(slots); ++i) {
+        const long long slot = slots[i] * 1000LL;
+        const long long bound = (begin + slot - 1) / slot * slot;
+        timeval aligned = maketime(long(bound / 1000000), long(bound % 1000000));
+        if (aligned < latest || aligned == latest)
+            return aligned;
+    }
+    return latest;
+}
+
 void YTimer::fuzzTimer() {
     if (false == fFixed && inrange(DelayFuzziness, 1, 100)) {
         // non-fixed timer: configure fuzzy timeout range
         // to allow for merging of several timers
         timeval fuzz = millitime((fInterval * DelayFuzziness) / 100L);
         timeout_min = timeout - fuzz;
-        timeout_max = timeout + fuzz;
+        timeout_max = alignTimeout(timeout_min, timeout + fuzz);
     } else {
         timeout_min = timeout;
         timeout_max = timeout;
@@ -157,13 +178,14 @@ void YTimer::stopTimer() {
 }
 
 void YTimer::enlist(bool enable) {
-    if (fRunning != enable) {
-        fRunning = enable;
-        if (enable) {
-            mainLoop->registerTimer(this);
-        } else {
-            mainLoop->unregisterTimer(this);
-        }
+    if (enable) {
+        // also when running, to reschedule on the new timeout
+        fRunning = true;
+        mainLoop->registerTimer(this);
+    }
+    else if (fRunning) {
+        fRunning = false;
+        mainLoop->unregisterTimer(this);
     }
 }
 
@@ -186,4 +208,102 @@ void YTimer::setTimer(long interval, YTimerListener *listener, bool start) {
         startTimer();
 }
 
+void YTimerHeap::insert(YTimer *t) {
+    fHeap.append(t);
+    siftUp(getCount() - 1);
+}
+
+void YTimerHeap::remove(YTimer *t) {
+    int index = t->fHeapIndex[fLimit];
+    PRECONDITION(index < getCount() && fHeap[index] == t);
+    int last = getCount() - 1;
+    if (index < last) {
+        place(index, fHeap[last]);
+        fHeap.remove(last);
+        update(fHeap[index]);
+    } else {
+        fHeap.remove(last);
+    }
+    t->fHeapIndex[fLimit] = -1;
+}
+
+void YTimerHeap::update(YTimer *t) {
+    int index = t->fHeapIndex[fLimit];
+    if (index > 0 && before(t, fHeap[(index - 1) / 2]))
+        siftUp(index);
+    else
+        siftDown(index);
+}
+
+void YTimerHeap::siftUp(int index) {
+    YTimer *t = fHeap[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (before(t, fHeap[parent]) == false)
+            break;
+        place(index, fHeap[parent]);
+        index = parent;
+    }
+    place(index, t);
+}
+
+void YTimerHeap::siftDown(int index) {
+    YTimer *t = fHeap[index];
+    const int count = getCount();
+    for (int child = 2 * index + 1; child < count; child = 2 * index + 1) {
+        if (child + 1 < count && before(fHeap[child + 1], fHeap[child]))
+            child += 1;
+        if (before(fHeap[child], t) == false)
+            break;
+        place(index, fHeap[child]);
+        index = child;
+    }
+    place(index, t);
+}
+
+void YTimerQueue::schedule(YTimer *t) {
+    if (t->fHeapIndex[YTimerHeap::Earliest] >= 0) {
+        fEarliest.update(t);
+        fLatest.update(t);
+    } else {
+        fEarliest.insert(t);
+        fLatest.insert(t);
+    }
+}
+
+void YTimerQueue::cancel(YTimer *t) {
+    if (t->fHeapIndex[YTimerHeap::Earliest] >= 0) {
+        fEarliest.remove(t);
+        fLatest.remove(t);
+    }
+}
+
+bool YTimerQueue::deadline(timeval *timeout) const {
+    YTimer *t = fLatest.top();
+    if (t)
+        *timeout = t->timeout_max;
+    return t != 0;
+}
+
+YTimer *YTimerQueue::expired(const timeval& now) {
+    // A timer which is restarted by its handler with a timeout
+    // in the past must wait for the next round, lest we loop.
+    YTimer *t = fEarliest.top();
+    if (t && t->timeout_min < now && t->fSerial != fSerial) {
+        t->fSerial = fSerial;
+        return t;
+    }
+    return 0;
+}
+
+void YTimerQueue::shift(const timeval& diff) {
+    // a uniform shift preserves the heap order
+    for (int i = 0; i < fEarliest.getCount(); ++i) {
+        YTimer *t = fEarliest[i];
+        t->timeout_min += diff;
+        t->timeout += diff;
+        t->timeout_max += diff;
+    }
+}
+
 // vim: set sw=4 ts=4 et:
@@ -81,10 +81,14 @@ private:
     long fInterval;
     bool fRunning;
     bool fFixed;
+    unsigned fSerial;
+    int fHeapIndex[2];
 
     struct timeval timeout_min, timeout, timeout_max;
 
     friend class YApplication;
+    friend class YTimerHeap;
+    friend class YTimerQueue;
 };
 
 #endif
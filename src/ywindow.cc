@@ -23,6 +23,118 @@
 /******************************************************************************/
 /******************************************************************************/
 
+/*
+ * Back buffers for double buffered painting.  Sizes are rounded up,
+ * so a buffer can be reused for windows of a similar size.  Buffers
+ * which were not used for a few seconds are freed, and so are the
+ * least recently used buffers when the pool exceeds its memory limit.
+ */
+class YBufferPool : private YTimerListener {
+public:
+    YBufferPool();
+
+    ref<YPixmap> take(unsigned width, unsigned height, unsigned depth);
+    void give(ref<YPixmap> pixmap);
+    void statistics();
+
+private:
+    enum {
+        PoolLimit = 8 << 20,    // bytes of pixmap memory kept
+        TrimPeriod = 3000,      // idle buffers go after one to two periods
+    };
+
+    virtual bool handleTimer(YTimer* timer);
+    static unsigned round(unsigned n);
+    static unsigned long bytes(ref<YPixmap> pixmap);
+    void drop(int index);
+
+    YRefArray<YPixmap> fBuffers;    // least recently used first
+    YArray<unsigned> fUsed;         // tick of last use
+    unsigned fTicks;
+    unsigned long fBytes;
+    unsigned long fReused;
+    unsigned long fCreated;
+    YTimer fTrimTimer;
+};
+
+YBufferPool::YBufferPool():
+    fTicks(0),
+    fBytes(0),
+    fReused(0),
+    fCreated(0),
+    fTrimTimer(TrimPeriod, this, false)
+{
+}
+
+unsigned YBufferPool::round(unsigned n) {
+    return n <= 32 ? (n + 7) & ~7U
+         : n <= 256 ? (n + 31) & ~31U
+         : (n + 127) & ~127U;
+}
+
+unsigned long YBufferPool::bytes(ref<YPixmap> pixmap) {
+    unsigned depth = pixmap->depth();
+    unsigned pixel = depth <= 8 ? 1 : depth <= 16 ? 2 : 4;
+    return (unsigned long) pixmap->width() * pixmap->height() * pixel;
+}
+
+ref<YPixmap> YBufferPool::take(unsigned width, unsigned height,
+                               unsigned depth)
+{
+    const unsigned w = round(width), h = round(height);
+    for (int i = fBuffers.getCount(); --i >= 0; ) {
+        ref<YPixmap> pixmap(fBuffers[i]);
+        if (pixmap->width() == w && pixmap->height() == h &&
+            pixmap->depth() == depth)
+        {
+            drop(i);
+            ++fReused;
+            return pixmap;
+        }
+    }
+    ++fCreated;
+    return YPixmap::create(w, h, depth);
+}
+
+void YBufferPool::give(ref<YPixmap> pixmap) {
+    if (pixmap == null || bytes(pixmap) > PoolLimit)
+        return;
+
+    fBuffers.append(pixmap);
+    fUsed.append(fTicks);
+    fBytes += bytes(pixmap);
+    while (fBytes > PoolLimit)
+        drop(0);
+
+    if (fTrimTimer.isRunning() == false)
+        fTrimTimer.startTimer();
+}
+
+void YBufferPool::drop(int index) {
+    fBytes -= bytes(fBuffers[index]);
+    fBuffers.remove(index);
+    fUsed.remove(index);
+}
+
+bool YBufferPool::handleTimer(YTimer* timer) {
+    ++fTicks;
+    for (int i = fBuffers.getCount(); --i >= 0; ) {
+        if (fTicks - fUsed[i] >= 2)
+            drop(i);
+    }
+    return fBuffers.nonempty();
+}
+
+void YBufferPool::statistics() {
+    if (fReused + fCreated) {
+        tlog("paint buffers: %lu reused, %lu created, %d kept (%lu kB)",
+             fReused, fCreated, fBuffers.getCount(), fBytes / 1024);
+    }
+}
+
+/******************************************************************************/
+/******************************************************************************/
+
 void YWindow::addIgnoreUnmap(Window /*w*/) {
     unmapCount++;
 }
@@ -102,6 +214,10 @@ int YWindow::fClickDrag = 0;
 unsigned int YWindow::fClickButton = 0;
 unsigned int YWindow::fClickButtonDown = 0;
 
+unsigned long YWindow::fExposeCount;
+unsigned long YWindow::fPaintCount;
+lazy<YBufferPool> YWindow::fBufferPool;
+
 unsigned long YWindow::lastEnterNotifySerial; // credits to ahwm
 unsigned long YWindow::getLastEnterNotifySerial() {
     return lastEnterNotifySerial;
@@ -738,9 +854,7 @@ void YWindow::handleEvent(const XEvent &event) {
 }
 
 ref<YPixmap> YWindow::beginPaint(YRect &r) {
-    //    return new YPixmap(width(), height());
-    ref<YPixmap> pix = YPixmap::create(r.width(), r.height(), depth());
-    return pix;
+    return fBufferPool->take(r.width(), r.height(), depth());
 }
 
 void YWindow::endPaint(Graphics &g, ref<YPixmap> pixmap, YRect &r) {
@@ -748,6 +862,7 @@ void YWindow::endPaint(Graphics &g, ref<YPixmap> pixmap, YRect &r) {
         g.copyPixmap(pixmap,
                      0, 0, /*r.x(), r.y(),*/ r.width(), r.height(),
                      r.x(), r.y());
+        fBufferPool->give(pixmap);
     }
 }
 
@@ -755,8 +870,12 @@ void YWindow::setDoubleBuffer(bool flag) {
     fDoubleBuffer = flag;
 }
 
-/// TODO #warning "implement expose compression"
 void YWindow::paintExpose(int ex, int ey, int ew, int eh) {
+    addDamage(ex, ey, ew, eh);
+    paintDamage();
+}
+
+void YWindow::addDamage(int ex, int ey, int ew, int eh) {
     if (ex < 0) {
         ew += ex;
         ex = 0;
@@ -768,34 +887,97 @@ void YWindow::paintExpose(int ex, int ey, int ew, int eh) {
     ew = min(ew, int(width()) - ex);
     eh = min(eh, int(height()) - ey);
     if (ew > 0 && eh > 0) {
-        Graphics& g = getGraphics();
         XRectangle r = {
             short(ex),
             short(ey),
             static_cast<unsigned short>(ew),
             static_cast<unsigned short>(eh),
         };
-        g.setClipRectangles(&r, 1);
-        YRect r1(ex, ey, unsigned(ew), unsigned(eh));
+        fDamage.append(r);
+    }
+}
+
+// Repaint the bounding box of the damage once, clipped to the damage.
+void YWindow::paintDamage() {
+    YArray<XRectangle> damage(fDamage);
+    const int count = damage.getCount();
+    if (count == 0)
+        return;
+
+    int x1 = damage[0].x, y1 = damage[0].y;
+    int x2 = x1 + damage[0].width, y2 = y1 + damage[0].height;
+    for (int i = 1; i < count; ++i) {
+        const XRectangle& r = damage[i];
+        x1 = min(x1, int(r.x));
+        y1 = min(y1, int(r.y));
+        x2 = max(x2, r.x + int(r.width));
+        y2 = max(y2, r.y + int(r.height));
+    }
+    x2 = min(x2, int(width()));
+    y2 = min(y2, int(height()));
+
+    if (x1 < x2 && y1 < y2) {
+        Graphics& g = getGraphics();
+        g.setClipRectangles(&damage[0], count);
+        YRect r1(x1, y1, unsigned(x2 - x1), unsigned(y2 - y1));
         if (fDoubleBuffer) {
             ref<YPixmap> pixmap = beginPaint(r1);
-            Graphics g1(pixmap, ex, ey);
-            //MSG(("paint %d %d %d %d", ex, ey, ew, eh));
+            Graphics g1(pixmap, x1, y1);
+            //MSG(("paint %d %d %d %d", x1, y1, x2 - x1, y2 - y1));
             paint(g1, r1);
             endPaint(g, pixmap, r1);
         } else {
             paint(g, r1);
         }
         g.resetClip();
+        ++fPaintCount;
     }
 }
 
+// Expose events come in series, where only the last has a zero count.
+// Gather the series and any further queued exposures, then paint once.
 void YWindow::handleExpose(const XExposeEvent &expose) {
-    paintExpose(expose.x, expose.y, expose.width, expose.height);
+    ++fExposeCount;
+    addDamage(expose.x, expose.y, expose.width, expose.height);
+    if (expose.count == 0) {
+        XEvent next;
+        while (XCheckTypedWindowEvent(xapp->display(), handle(),
+                                      Expose, &next))
+        {
+            ++fExposeCount;
+            addDamage(next.xexpose.x, next.xexpose.y,
+                      next.xexpose.width, next.xexpose.height);
+        }
+        paintDamage();
+    }
 }
 
 void YWindow::handleGraphicsExpose(const XGraphicsExposeEvent &expose) {
-    paintExpose(expose.x, expose.y, expose.width, expose.height);
+    ++fExposeCount;
+    addDamage(expose.x, expose.y, expose.width, expose.height);
+    if (expose.count == 0) {
+        XEvent next;
+        while (XCheckTypedWindowEvent(xapp->display(), handle(),
+                                      GraphicsExpose, &next))
+        {
+            ++fExposeCount;
+            addDamage(next.xgraphicsexpose.x, next.xgraphicsexpose.y,
+                      next.xgraphicsexpose.width, next.xgraphicsexpose.height);
+        }
+        paintDamage();
+    }
+}
+
+void YWindow::statistics() {
+    if (fExposeCount) {
+        tlog("expose: %lu events, %lu paints", fExposeCount, fPaintCount);
+    }
+    if (fBufferPool)
+        fBufferPool->statistics();
+}
+
+void YWindow::releaseBuffers() {
+    fBufferPool = null;
 }
 
 void YWindow::handleConfigure(const XConfigureEvent &configure) {
@@ -1685,7 +1867,8 @@ bool YWindow::hasPopup() {
 }
 
 YDesktop::YDesktop(YWindow *aParent, Window win):
-    YWindow(aParent, win)
+    YWindow(aParent, win),
+    fRefreshRate(0)
 {
     desktop = this;
     setDoubleBuffer(false);
@@ -1943,6 +2126,7 @@ Pixmap YWindow::createPixmap() {
 
 void YDesktop::updateXineramaInfo(unsigned &w, unsigned &h) {
     xiInfo.clear();
+    fRefreshRate = 0;
 
 #ifdef CONFIG_XRANDR
     bool gotLayout = false;
@@ -1966,6 +2150,18 @@ void YDesktop::updateXineramaInfo(unsigned &w, unsigned &h) {
                 si.height = ci->height;
                 xiInfo.append(si);
             }
+            for (int m = 0; ci->mode != None && m < xrrsr->nmode; m++) {
+                const XRRModeInfo& mi = xrrsr->modes[m];
+                double lines = double(mi.vTotal);
+                if (mi.modeFlags & RR_DoubleScan)
+                    lines *= 2;
+                if (mi.modeFlags & RR_Interlace)
+                    lines /= 2;
+                if (mi.id == ci->mode && mi.hTotal && mi.vTotal) {
+                    int rate = int(0.5 + mi.dotClock / (mi.hTotal * lines));
+                    fRefreshRate = max(fRefreshRate, rate);
+                }
+            }
             XRRFreeCrtcInfo(ci);
         }
 
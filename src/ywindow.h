@@ -10,6 +10,7 @@
 class YPopupWindow;
 class YToolTip;
 class YTimer;
+class YBufferPool;
 class YAutoScroll;
 class YRect;
 class YRect2;
@@ -143,6 +144,10 @@ public:
     ref<YPixmap> beginPaint(YRect &r);
     void endPaint(Graphics &g, ref<YPixmap> pixmap, YRect &r);
     void paintExpose(int ex, int ey, int ew, int eh);
+    void addDamage(int ex, int ey, int ew, int eh);
+    void paintDamage();
+    static void statistics();
+    static void releaseBuffers();
 
     Graphics & getGraphics();
 
@@ -284,6 +289,12 @@ private:
     bool fToplevel;
     bool fDoubleBuffer;
 
+    // Exposed rectangles which are not yet repainted.
+    YArray<XRectangle> fDamage;
+    static unsigned long fExposeCount;
+    static unsigned long fPaintCount;
+    static lazy<YBufferPool> fBufferPool;
+
     struct YAccelerator {
         unsigned key;
         unsigned mod;
@@ -331,10 +342,14 @@ public:
 
     int getScreenCount();
 
+    // The highest refresh rate of the monitors in Hz, or 0 if unknown.
+    int refreshRate() const { return fRefreshRate; }
+
     virtual void grabKeys() {}
 
 protected:
     YArray<DesktopScreenInfo> xiInfo;
+    int fRefreshRate;
 };
 
 extern YDesktop *desktop;
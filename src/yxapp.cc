@@ -18,7 +18,7 @@
 YXApplication *xapp = 0;
 
 YDesktop *desktop = 0;
-YContext<YWindow> windowContext;
+YContext<YWindow> windowContext("windowContext", false);
 
 YCursor YXApplication::leftPointer;
 YCursor YXApplication::rightPointer;
@@ -1089,6 +1089,8 @@ void YXApplication::initExtensions() {
 }
 
 YXApplication::~YXApplication() {
+    YWindow::releaseBuffers();
+
     if (fColormap32 != CopyFromParent)
         XFreeColormap(xapp->display(), fColormap32);
 
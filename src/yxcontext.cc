@@ -0,0 +1,162 @@
+/*
+ * IceWM - hash table mapping windows to objects
+ */
+#include "config.h"
+#include "base.h"
+#include <X11/Xlib.h>
+#include "yxcontext.h"
+#include <string.h>
+
+YAnyContext::YAnyContext(const char* title, bool verbose) :
+    slots(0),
+    capacity(0),
+    count(0),
+    nonePointer(0),
+    hasNone(false),
+    lookups(0),
+    probes(0),
+    longest(0),
+    title(title),
+    verbose(verbose)
+{
+}
+
+YAnyContext::~YAnyContext() {
+    delete[] slots;
+    if (verbose) {
+        tlog("%s: destroyed", title);
+    }
+}
+
+YAnyContext::Slot* YAnyContext::lookup(Window w) {
+    unsigned length = 1;
+    Slot* slot = 0;
+    if (capacity) {
+        for (unsigned i = home(w); slots[i].window != None; i = next(i)) {
+            if (slots[i].window == w) {
+                slot = &slots[i];
+                break;
+            }
+            ++length;
+        }
+    }
+    lookups += 1;
+    probes += length;
+    if (longest < length)
+        longest = length;
+    return slot;
+}
+
+void YAnyContext::resize(unsigned size) {
+    Slot* old = slots;
+    unsigned oldCapacity = capacity;
+
+    slots = new Slot[size];
+    memset(slots, 0, size * sizeof(Slot));
+    capacity = size;
+    for (unsigned k = 0; k < oldCapacity; ++k) {
+        if (old[k].window != None) {
+            unsigned i = home(old[k].window);
+            while (slots[i].window != None)
+                i = next(i);
+            slots[i] = old[k];
+        }
+    }
+    delete[] old;
+
+    if (verbose) {
+        tlog("%s: resized to %u", title, capacity);
+    }
+}
+
+void YAnyContext::save(Window w, AnyPointer p) {
+    if (w == None) {
+        nonePointer = p;
+        hasNone = true;
+    }
+    else if (Slot* slot = lookup(w)) {
+        slot->pointer = p;
+    }
+    else {
+        // keep the load factor at most one half
+        if (2 * (count + 1) > capacity)
+            resize(capacity ? 2 * capacity : 64);
+        unsigned i = home(w);
+        while (slots[i].window != None)
+            i = next(i);
+        slots[i].window = w;
+        slots[i].pointer = p;
+        count += 1;
+    }
+    if (verbose) {
+        tlog("%s: save 0x%lx to %p", title, w, p);
+    }
+}
+
+bool YAnyContext::find(Window w, AnyPointer* p) {
+    bool found = false;
+    *p = 0;
+    if (w == None) {
+        if (hasNone) {
+            *p = nonePointer;
+            found = true;
+        }
+    }
+    else if (Slot* slot = lookup(w)) {
+        *p = slot->pointer;
+        found = true;
+    }
+    if (verbose) {
+        if (found)
+            tlog("%s: find 0x%lx found %p", title, w, *p);
+        else
+            tlog("%s: find 0x%lx not found", title, w);
+    }
+    return found;
+}
+
+bool YAnyContext::remove(Window w) {
+    bool found = false;
+    if (w == None) {
+        found = hasNone;
+        hasNone = false;
+        nonePointer = 0;
+    }
+    else if (Slot* slot = lookup(w)) {
+        // Shift back the following entries of the cluster
+        // which may not skip the vacated slot, so that
+        // no tombstones are needed.
+        unsigned hole = unsigned(slot - slots);
+        for (unsigned i = next(hole); slots[i].window != None; i = next(i)) {
+            unsigned want = home(slots[i].window);
+            bool stays = (hole < i)
+                       ? (hole < want && want <= i)
+                       : (hole < want || want <= i);
+            if (stays == false) {
+                slots[hole] = slots[i];
+                hole = i;
+            }
+        }
+        slots[hole].window = None;
+        slots[hole].pointer = 0;
+        count -= 1;
+        found = true;
+    }
+    if (verbose) {
+        if (found)
+            tlog("%s: remove for 0x%lx", title, w);
+        else
+            tlog("%s: remove for 0x%lx failed", title, w);
+    }
+    return found;
+}
+
+void YAnyContext::statistics() {
+    tlog("%s: %u windows, capacity %u, load %.2f, "
+         "%lu lookups, %.2f probes per lookup, longest %u",
+         title ? title : "context", count, capacity,
+         capacity ? double(count) / capacity : 0.0,
+         lookups, lookups ? double(probes) / lookups : 0.0, longest);
+}
+
+// vim: set sw=4 ts=4 et:
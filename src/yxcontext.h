@@ -1,80 +1,67 @@
 #ifndef __YXCONTEXT_H
 #define __YXCONTEXT_H
 
-#ifndef NULLQUARK
-#include <X11/Xresource.h>
-#endif
+#include <X11/X.h>
 
+/*
+ * Map windows to pointers in an open addressing hash table
+ * with linear probing. Unlike XContext it takes no display lock
+ * and it grows with the number of windows.
+ */
 class YAnyContext {
 protected:
     typedef void* AnyPointer;
 
 private:
-    XContext unique;
+    struct Slot {
+        Window window;
+        AnyPointer pointer;
+    };
+
+    Slot* slots;        // capacity is a power of two; None marks empty
+    unsigned capacity;
+    unsigned count;
+    AnyPointer nonePointer;
+    bool hasNone;
+
+    unsigned long lookups;
+    unsigned long probes;
+    unsigned longest;
+
     const char* title;
     const bool verbose;
 
-    XContext context() {
-        if (unique == 0) {
-            unique = XUniqueContext();
-            if (verbose) {
-                tlog("%s: created", title);
-            }
-        }
-        return unique;
+    unsigned home(Window w) const {
+        unsigned long long h = w;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return unsigned(h) & (capacity - 1);
     }
+    unsigned next(unsigned index) const {
+        return (index + 1) & (capacity - 1);
+    }
+    Slot* lookup(Window w);
+    void resize(unsigned size);
 
-    Display* dpy() const { return xapp->display(); }
+    YAnyContext(const YAnyContext&); // not implemented
+    void operator=(const YAnyContext&); // not implemented
 
 public:
-    YAnyContext(const char* title = 0, bool verbose = false) :
-        unique(0),
-        title(title),
-        verbose(verbose)
-    {
-    }
-
-    ~YAnyContext() {
-        if (verbose) {
-            tlog("%s: destroyed", title);
-        }
-    }
+    YAnyContext(const char* title = 0, bool verbose = false);
+    ~YAnyContext();
 
     // store mapping of window to pointer
-    void save(Window w, AnyPointer p) {
-        const char* q = static_cast<const char *>(p);
-        XSaveContext(dpy(), w, context(), q);
-        if (verbose) {
-            tlog("%s: save 0x%lx to %p", title, w, p);
-        }
-    }
+    void save(Window w, AnyPointer p);
 
     // lookup pointer by window
-    bool find(Window w, AnyPointer* p) {
-        char* q = 0;
-        int rc = XFindContext(dpy(), w, context(), &q);
-        if (verbose) {
-            if (rc == 0)
-                tlog("%s: find 0x%lx found %p", title, w,
-                        reinterpret_cast<void *>(p));
-            else
-                tlog("%s: find 0x%lx not found", title, w);
-        }
-        *p = q;
-        return rc == 0;
-    }
+    bool find(Window w, AnyPointer* p);
 
     // remove mapping of window to pointer
-    bool remove(Window w) {
-        int rc = XDeleteContext(dpy(), w, context());
-        if (verbose) {
-            if (rc == 0)
-                tlog("%s: remove for 0x%lx", title, w);
-            else
-                tlog("%s: remove for 0x%lx failed", title, w);
-        }
-        return rc == 0;
-    }
+    bool remove(Window w);
+
+    // log load factor and probe lengths
+    void statistics();
 };
 
 template <typename T>
@@ -110,6 +97,8 @@ public:
     bool remove(Window w) {
         return YAnyContext::remove(w);
     }
+
+    using YAnyContext::statistics;
 };
 
 class YFrameClient;
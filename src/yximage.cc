@@ -8,11 +8,11 @@
 #if defined CONFIG_XPM
 
 #include <stdlib.h>
-#include <math.h>
 #include <errno.h>
 #include "yimage.h"
 #include "yxapp.h"
 #include "ypointer.h"
+#include "yscale.h"
 #include "intl.h"
 
 #include <X11/xpm.h>
@@ -80,6 +80,8 @@ public:
     bool hasAlpha() const { return fImage ? fImage->depth == 32 : false; }
     ref<YImage> upscale(unsigned width, unsigned height);
     ref<YImage> downscale(unsigned width, unsigned height);
+    XImage* resample(unsigned width, unsigned height, unsigned depth,
+                     bool normalize);
     virtual ref<YImage> subimage(int x, int y, unsigned width, unsigned height);
     virtual void save(upath filename);
 
@@ -643,262 +645,115 @@ ref<YImage> YXImage::loadjpg(upath filename)
 }
 #endif
 
-ref<YImage> YXImage::upscale(unsigned nw, unsigned nh)
+// Scale with area averaging into a new image of the given depth.
+XImage* YXImage::resample(unsigned nw, unsigned nh, unsigned depth,
+                          bool normalize)
 {
-    ref<YImage> image;
-    XImage *ximage = 0;
-    double *chanls = 0;
-    double *counts = 0;
-    double *colors = 0;
-
-    if (!valid()) {
-        tlog("ERROR: not a valid YXImage\n");
-        goto error;
+    XImage* ximage = createImage(nw, nh, depth);
+    if (ximage == 0)
+        return 0;
+
+    const unsigned w = fImage->width;
+    const unsigned h = fImage->height;
+    const bool has_alpha = hasAlpha();
+
+    // Scale the image data directly when both have 32 bits per pixel
+    // in the same byte order, otherwise go through XGetPixel.
+    const bool direct = (!fBitmap &&
+                         fImage->format == ZPixmap &&
+                         fImage->bits_per_pixel == 32 &&
+                         ximage->bits_per_pixel == 32 &&
+                         fImage->byte_order == ximage->byte_order);
+    unsigned* input = 0;
+    unsigned* output = 0;
+    const unsigned char* source;
+    unsigned char* target;
+    unsigned sourceStride, targetStride;
+    unsigned alpha;
+
+    if (direct) {
+        source = (const unsigned char *) fImage->data;
+        sourceStride = unsigned(fImage->bytes_per_line);
+        target = (unsigned char *) ximage->data;
+        targetStride = unsigned(ximage->bytes_per_line);
+        alpha = (ximage->byte_order == MSBFirst) ? 0 : 3;
     }
-    {
-        unsigned w = fImage->width;
-        unsigned h = fImage->height;
-        bool has_alpha = hasAlpha();
-
-        // tlog("upscale from %ux%ux%u to %ux%u\n", w, h, d, nw, nh);
-        ximage = createImage(nw, nh, fImage->depth);
-        if (ximage == 0) {
-            goto error;
-        }
-        // tlog("created upscale ximage at %ux%ux%u\n", ximage->width, ximage->height, ximage->depth);
-        if (!(chanls = (double *)calloc(ximage->bytes_per_line * ximage->height, 4 * sizeof(*chanls)))) {
-            tlog("ERROR: could not allocate working arrays\n");
-            goto error;
-        }
-        if (!(counts = (double *)calloc(ximage->bytes_per_line * ximage->height, sizeof(*counts)))) {
-            tlog("ERROR: could not allocate working arrays\n");
-            goto error;
+    else {
+        input = new unsigned[w * h];
+        for (unsigned j = 0; j < h; j++) {
+            for (unsigned i = 0; i < w; i++) {
+                unsigned long pixel = XGetPixel(fImage, i, j);
+                if (fBitmap && (pixel & 0x00FFFFFF))
+                    pixel |= 0x00FFFFFF;
+                input[j * w + i] = unsigned(pixel);
+            }
         }
-        if (!(colors = (double *)calloc(ximage->bytes_per_line * ximage->height, sizeof(*colors)))) {
-            tlog("ERROR: could not allocate working arrays\n");
-            goto error;
+        output = new unsigned[nw * nh];
+        source = (const unsigned char *) input;
+        sourceStride = 4 * w;
+        target = (unsigned char *) output;
+        targetStride = 4 * nw;
+        const unsigned one = 1;
+        alpha = *(const unsigned char *) &one ? 3 : 0;
+    }
+
+    YScaler(w, h, nw, nh).scale(source, sourceStride, target, targetStride);
+
+    unsigned amax = 0;
+    for (unsigned l = 0; l < nh; l++) {
+        unsigned char* a = target + l * targetStride + alpha;
+        for (unsigned k = 0; k < nw; k++, a += 4) {
+            if (!has_alpha)
+                *a = 0xFF;
+            else if (amax < *a)
+                amax = *a;
         }
-        {
-            double pppx = (double) w / (double) nw;
-            double pppy = (double) h / (double) nh;
-
-            double ty, by; unsigned l;
-            for (ty = 0.0, by = pppy, l = 0; l < nh; l++, ty += pppy, by += pppy) {
-                for (unsigned j = floor(ty); j < by; j++) {
-                    double yf = 1.0;
-                    if (ty < (j + 1) && (j + 1) < by)
-                        yf = (j + 1) - ty;
-                    else if (ty < j && j < by)
-                        yf = by - j;
-                    double lx, rx; unsigned k;
-                    for (lx = 0.0, rx = pppx, k = 0; k < nw; k++, lx += pppx, rx += pppx) {
-                        for (unsigned i = floor(lx); i < rx; i++) {
-                            double xf = 1.0;
-                            if (lx < (i + 1) && (i + 1) < rx)
-                                xf = (i + 1) - lx;
-                            else if (lx < i && i < rx)
-                                xf = rx - i;
-                            double ff = xf * yf;
-                            unsigned m = l * nw + k;
-                            unsigned n = m << 2;
-                            counts[m] += ff;
-                            unsigned long pixel = XGetPixel(fImage, i, j);
-                            if (fBitmap && (pixel & 0x00FFFFFF))
-                                pixel |= 0x00FFFFFF;
-                            unsigned A = has_alpha ? (pixel >> 24) & 0xff : 255;
-                            unsigned R = (pixel >> 16) & 0xff;
-                            unsigned G = (pixel >>  8) & 0xff;
-                            unsigned B = (pixel >>  0) & 0xff;
-                            colors[m] += ff;
-                            chanls[n+0] += A * ff;
-                            chanls[n+1] += R * ff;
-                            chanls[n+2] += G * ff;
-                            chanls[n+3] += B * ff;
-                        }
-                    }
-                }
-            }
-            unsigned amax = 0;
-            for (unsigned l = 0; l < nh; l++) {
-                for (unsigned k = 0; k < nw; k++) {
-                    unsigned m = l * nw + k;
-                    unsigned n = m << 2;
-                    unsigned long pixel = 0;
-                    if (counts[m])
-                        pixel |= (lround(chanls[n+0] / counts[m]) & 0xff) << 24;
-                    if (colors[m]) {
-                        pixel |= (lround(chanls[n+1] / colors[m]) & 0xff) << 16;
-                        pixel |= (lround(chanls[n+2] / colors[m]) & 0xff) <<  8;
-                        pixel |= (lround(chanls[n+3] / colors[m]) & 0xff) <<  0;
-                    }
-                    XPutPixel(ximage, k, l, pixel);
-                    amax = max(amax, (unsigned)((pixel >> 24) & 0xff));
-                }
-            }
-            if (!amax)
-                /* no opacity at all! */
-                for (unsigned l = 0; l < nh; l++)
-                    for (unsigned k = 0; k < nw; k++)
-                        XPutPixel(ximage, k, l, XGetPixel(ximage, k, l) | 0xFF000000);
-            else if (amax < 255) {
-                double bump = (double) 255 / (double) amax;
-                for (unsigned l = 0; l < nh; l++)
-                    for (unsigned k = 0; k < nw; k++) {
-                        unsigned long pixel = XGetPixel(ximage, k, l);
-                        amax = (pixel >> 24) & 0xff;
-                        amax = lround((double) amax * bump);
-                        if (amax > 255)
-                            amax = 255;
-                        pixel = (pixel & 0x00FFFFFF) | (amax << 24);
-                        XPutPixel(ximage, k, l, pixel);
-                    }
+    }
+    if (has_alpha && normalize && amax < 255) {
+        /* no opacity at all, or raise the highest opacity to 255 */
+        for (unsigned l = 0; l < nh; l++) {
+            unsigned char* a = target + l * targetStride + alpha;
+            for (unsigned k = 0; k < nw; k++, a += 4) {
+                if (amax == 0)
+                    *a = 0xFF;
+                else
+                    *a = (unsigned char) min(255U, (*a * 255 + amax / 2) / amax);
             }
-            image.init(new YXImage(ximage, fBitmap));
-            ximage = 0; // consumed above
         }
     }
-  error:
-    if (chanls)
-        free(chanls);
-    if (counts)
-        free(counts);
-    if (colors)
-        free(colors);
-    if (ximage)
-        XDestroyImage(ximage);
-    return image;
+
+    if (output) {
+        for (unsigned l = 0; l < nh; l++)
+            for (unsigned k = 0; k < nw; k++)
+                XPutPixel(ximage, k, l, output[l * nw + k]);
+    }
+    delete[] input;
+    delete[] output;
+    return ximage;
 }
 
-// image downscaling using a fast bilinear interpolation algorithm
-ref<YImage> YXImage::downscale(unsigned newWidth, unsigned newHeight)
+ref<YImage> YXImage::upscale(unsigned nw, unsigned nh)
 {
-    const unsigned oldWidth = this->width();
-    const unsigned oldHeight = this->height();
-    const unsigned shift = 10;
-
-    PRECONDITION(inrange(newWidth, 1U, oldWidth));
-    PRECONDITION(inrange(newHeight, 1U, oldHeight));
+    if (!valid()) {
+        tlog("ERROR: not a valid YXImage\n");
+        return null;
+    }
 
-    XImage* ximage = createImage(newWidth, newHeight, 32U);
+    XImage* ximage = resample(nw, nh, fImage->depth, true);
     if (ximage == 0)
         return null;
 
-    unsigned long *red = new unsigned long[newWidth];
-    unsigned long *grn = new unsigned long[newWidth];
-    unsigned long *blu = new unsigned long[newWidth];
-    unsigned long *alp = new unsigned long[newWidth];
-    unsigned long *div = new unsigned long[newWidth];
-
-    unsigned hacc = 0;
-    unsigned h = 0;
-    unsigned mult = 0;
-    bool repeat = false;
-
-    for (unsigned y = 0; y < oldHeight; y = repeat ? y : 1 + y) {
-        if (hacc < newHeight) {
-            memset(red, 0, sizeof(*red) * newWidth);
-            memset(grn, 0, sizeof(*grn) * newWidth);
-            memset(blu, 0, sizeof(*blu) * newWidth);
-            memset(alp, 0, sizeof(*alp) * newWidth);
-            memset(div, 0, sizeof(*div) * newWidth);
-        }
-
-        if (repeat) {
-            repeat = false;
-            mult = (1 << shift) - mult;
-        }
-        else {
-            hacc += newHeight;
-            if (hacc <= oldHeight) {
-                mult = 1 << shift;
-            }
-            else {
-                mult = ((newHeight / 2) + (1 << shift)
-                     * (newHeight - (hacc - oldHeight)))
-                     / newHeight;
-            }
-        }
-
-        unsigned wacc = 0;
-        unsigned w = 0;
-        unsigned char* idata = (unsigned char *) fImage->data
-                               + y * fImage->bytes_per_line;
-        const bool has_alpha = hasAlpha();
-        for (unsigned x = 0; x < oldWidth; ++x) {
-            unsigned char r, g, b, a;
-            if (fImage->byte_order == MSBFirst) {
-                a = has_alpha ? *idata++ : 0xFF;
-                r = *idata++;
-                g = *idata++;
-                b = *idata++;
-            } else {
-                b = *idata++;
-                g = *idata++;
-                r = *idata++;
-                a = has_alpha ? *idata++ : 0xFF;
-            }
-
-            wacc += newWidth;
-            if (wacc < oldWidth) {
-                red[w] += (mult << shift) * r;
-                grn[w] += (mult << shift) * g;
-                blu[w] += (mult << shift) * b;
-                alp[w] += (mult << shift) * a;
-                div[w] += mult << shift;
-            }
-            else {
-                unsigned m = (newWidth / 2 + (1 << shift)
-                           * (newWidth - (wacc - oldWidth)))
-                           / newWidth;
-                red[w] += m * mult * r;
-                grn[w] += m * mult * g;
-                blu[w] += m * mult * b;
-                alp[w] += m * mult * a;
-                div[w] += m * mult;
-                ++w;
-                wacc -= oldWidth;
-                if (wacc > 0) {
-                    m = (1 << shift) - m;
-                    red[w] += m * mult * r;
-                    grn[w] += m * mult * g;
-                    blu[w] += m * mult * b;
-                    alp[w] += m * mult * a;
-                    div[w] += m * mult;
-                }
-            }
-        }
+    return ref<YImage>(new YXImage(ximage, fBitmap));
+}
 
-        if (hacc >= oldHeight) {
-            hacc -= oldHeight;
-            if (hacc > 0) {
-                repeat = true;
-            }
-            unsigned char* odata = (unsigned char *) ximage->data
-                                   + h * ximage->bytes_per_line;
-            for (unsigned k = 0; k < newWidth; ++k) {
-                unsigned long d = non_zero(div[k]);
-                if (ximage->byte_order == MSBFirst) {
-                    *odata++ = (unsigned char) (alp[k] / d);
-                    *odata++ = (unsigned char) (red[k] / d);
-                    *odata++ = (unsigned char) (grn[k] / d);
-                    *odata++ = (unsigned char) (blu[k] / d);
-                }
-                else {
-                    *odata++ = (unsigned char) (blu[k] / d);
-                    *odata++ = (unsigned char) (grn[k] / d);
-                    *odata++ = (unsigned char) (red[k] / d);
-                    *odata++ = (unsigned char) (alp[k] / d);
-                }
-            }
-            ++h;
-        }
-    }
+ref<YImage> YXImage::downscale(unsigned newWidth, unsigned newHeight)
+{
+    PRECONDITION(inrange(newWidth, 1U, width()));
+    PRECONDITION(inrange(newHeight, 1U, height()));
 
-    delete[] red;
-    delete[] grn;
-    delete[] blu;
-    delete[] alp;
-    delete[] div;
+    XImage* ximage = resample(newWidth, newHeight, 32U, false);
+    if (ximage == 0)
+        return null;
 
     return ref<YImage>(new YXImage(ximage));
 }